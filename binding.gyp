@@ -9,6 +9,15 @@
             "cppsrc/SpinoDB.cpp",
             "cppsrc/Cursor.cpp",
             "cppsrc/Collection.cpp",
+            "cppsrc/HashIndex.cpp",
+            "cppsrc/QueryPlanner.cpp",
+            "cppsrc/QueryProgram.cpp",
+            "cppsrc/QueryCache.cpp",
+            "cppsrc/ResultCache.cpp",
+            "cppsrc/PreparedQuery.cpp",
+            "cppsrc/Regex.cpp",
+            "cppsrc/ThreadPool.cpp",
+            "cppsrc/Pipeline.cpp",
             "cppsrc/SpinoSquirrel.cpp",
             "cppsrc/SpinoWrapper.cpp",
             "cppsrc/Journal.cpp",
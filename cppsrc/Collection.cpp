@@ -21,21 +21,37 @@
 
 #include "Collection.h"
 #include "SpinoDB.h"
+#include "QueryPlanner.h"
+#include "Pipeline.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
 
 namespace Spino {
 
-    Collection::Collection(DocType& doc, JournalWriter& jw, std::string name) : name(name), doc(doc), jw(jw)  {
-        auto& arr = doc[name.c_str()];
-        if(arr.IsArray() == false) {
+    Collection::Collection(JournalWriter& jw, QueryCache& query_cache, ThreadPool& pool, 
+            std::string name) : 
+        name(name), dom(rapidjson::kArrayType), jw(jw), query_cache(query_cache), pool(pool)  {
+        id_counter = 0;	
+        last_append_timestamp = std::time(0); 
+    }
+
+    Collection::Collection(JournalWriter& jw, QueryCache& query_cache, ThreadPool& pool, 
+            std::string name, const ValueType& documents) : 
+        Collection(jw, query_cache, pool, name) {
+        if(documents.IsArray() == false) {
             std::cout << "WARNING: collection " 
                 << name 
                 << " is not an array. The database is corrupt." 
                 << std::endl;
+            return;
         }
-        id_counter = 0;	
-        last_append_timestamp = std::time(0); 
+
+        // copy the documents into this collection's own pool
+        dom.CopyFrom(documents, allocator);
+        assignSlots();
     }
 
     Collection::~Collection() {
@@ -48,40 +64,450 @@ namespace Spino {
         return name;
     }
 
-    void Collection::indexNewDoc() {
-        auto& arr = doc[name.c_str()];
-        ValueType& newdoc = arr[arr.Size()-1];
+    static PointerType pointerFromFieldName(const std::string& field_name) {
+        stringstream ss(field_name);
+        string intermediate;
+        string ptr;
+        while(getline(ss, intermediate, '.')) {
+            ptr += "/" + intermediate;
+        }
+        return PointerType(ptr.c_str());
+    }
 
-        for(auto& idx : indices) {
-            auto v = idx->field.Get(newdoc);
-            if(v) {
-                if(v->IsString()) {
-                    Value val;
-                    val.type = TYPE_STRING;
-                    val.str = v->GetString();
-                    idx->index.insert({val, arr.Size()-1});
-                } else if(v->IsNumber()) {
-                    Value val;
-                    val.type = TYPE_NUMERIC;
-                    val.numeric = v->GetDouble();
-                    idx->index.insert({val, arr.Size()-1});
+    Collection::Index::Index(const char* field_name, IndexKind kind) :
+        field_name(field_name),
+        kind(kind)
+    {
+        stringstream ss(field_name);
+        string name;
+        while(getline(ss, name, ',')) {
+            field_names.push_back(name);
+            fields.push_back(pointerFromFieldName(name));
+        }
+
+        if(field_names.size() > 1) {
+            // compound indices are always ordered so they can serve prefixes
+            compound = true;
+            this->kind = INDEX_ORDERED;
+        }
+        else {
+            field = pointerFromFieldName(field_name);
+        }
+    }
+
+    // only string and number values are indexed
+    static bool scalarKey(const ValueType& v, Value& val) {
+        if(v.IsString()) {
+            val.type = TYPE_STRING;
+            val.str.assign(v.GetString(), v.GetStringLength());
+            return true;
+        } else if(v.IsNumber()) {
+            val.type = TYPE_NUMERIC;
+            val.numeric = v.GetDouble();
+            return true;
+        }
+        return false;
+    }
+
+    bool Collection::Index::compoundKey(const ValueType& doc, std::vector<Value>& key) const {
+        key.resize(fields.size());
+        for(size_t i = 0; i < fields.size(); i++) {
+            auto v = fields[i].Get(doc);
+            Value& val = key[i];
+            if(v && v->IsString()) {
+                val.type = TYPE_STRING;
+                val.str = v->GetString();
+            } 
+            else if(v && v->IsNumber()) {
+                val.type = TYPE_NUMERIC;
+                val.numeric = v->GetDouble();
+            } 
+            else if(i == 0) {
+                return false;
+            }
+            else {
+                val.type = TYPE_UNDEFINED;
+            }
+        }
+        return true;
+    }
+
+    bool Collection::Index::keys(const ValueType& doc, std::vector<Value>& vals) const {
+        vals.clear();
+        auto v = field.Get(doc);
+        if(v == nullptr) {
+            return false;
+        }
+
+        Value val;
+        if(v->IsArray()) {
+            // objects and nested arrays in the array aren't indexed
+            for(auto& elem : v->GetArray()) {
+                if(scalarKey(elem, val)) {
+                    vals.push_back(val);
                 }
             }
+            std::sort(vals.begin(), vals.end());
+            vals.erase(std::unique(vals.begin(), vals.end(), 
+                        [](const Value& a, const Value& b) { 
+                            return !(a < b) && !(b < a); 
+                        }), vals.end());
+        }
+        else if(scalarKey(*v, val)) {
+            vals.push_back(val);
+        }
+        return !vals.empty();
+    }
+
+    bool Collection::Index::hashValue(const Value& val, uint32_t& h) {
+        if(val.type == TYPE_STRING) {
+            h = HashIndex::hashString(val.str.data(), val.str.size());
+            return true;
+        } else if(val.type == TYPE_NUMERIC) {
+            h = HashIndex::hashNumber(val.numeric);
+            return true;
         }
+        return false;
     }
 
+    static bool scalarMatches(const ValueType* v, const Value& val) {
+        if(v) {
+            if(val.type == TYPE_STRING) {
+                return v->IsString() && 
+                    (v->GetStringLength() == val.str.size()) &&
+                    (memcmp(v->GetString(), val.str.data(), val.str.size()) == 0);
+            } else if(val.type == TYPE_NUMERIC) {
+                return v->IsNumber() && (v->GetDouble() == val.numeric);
+            }
+        }
+        return false;
+    }
 
-    void Collection::append(ValueType& d) {
-        if(d.IsObject() == false) {
-            cout << "Spino Error: document is not an object" << endl;
+    bool Collection::Index::matches(const ValueType& doc, const Value& val) const {
+        auto v = field.Get(doc);
+        if(v && v->IsArray()) {
+            for(auto& elem : v->GetArray()) {
+                if(scalarMatches(&elem, val)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        return scalarMatches(v, val);
+    }
+
+    // inserts an entry into an ordered index and counts distinct keys
+    template <typename Set>
+    static void insertCounted(Set& set, typename Set::value_type&& entry, uint32_t& distinct) {
+        auto result = set.insert(std::move(entry));
+        if(!result.second) {
             return;
         }
-        if(doc.IsObject() == false) {
-            cout << "Spino Error: database corruption detected" << endl;
+
+        auto iter = result.first;
+        auto& key = iter->first;
+        bool seen = false;
+        if(iter != set.begin()) {
+            auto& prev = std::prev(iter)->first;
+            seen = !(prev < key) && !(key < prev);
+        }
+        auto next = std::next(iter);
+        if(!seen && (next != set.end())) {
+            seen = !(next->first < key) && !(key < next->first);
+        }
+        if(!seen) {
+            distinct++;
+        }
+    }
+
+    template <typename Set>
+    static void eraseCounted(Set& set, const typename Set::value_type& entry, uint32_t& distinct) {
+        auto iter = set.find(entry);
+        if(iter == set.end()) {
+            return;
+        }
+
+        auto& key = iter->first;
+        bool seen = false;
+        if(iter != set.begin()) {
+            auto& prev = std::prev(iter)->first;
+            seen = !(prev < key) && !(key < prev);
+        }
+        auto next = std::next(iter);
+        if(!seen && (next != set.end())) {
+            seen = !(next->first < key) && !(key < next->first);
+        }
+        if(!seen) {
+            distinct--;
+        }
+        set.erase(iter);
+    }
+
+    void Collection::Index::add(const ValueType& doc, uint32_t slot) {
+        if(compound) {
+            // compound entries hold one value per field, so arrays 
+            // aren't indexed. the planner doesn't use the index once
+            // it has seen one.
+            for(auto& f : fields) {
+                auto v = f.Get(doc);
+                if(v && v->IsArray()) {
+                    multikey = true;
+                }
+            }
+            std::vector<Value> key;
+            if(compoundKey(doc, key)) {
+                insertCounted(compound_index, {std::move(key), slot}, distinct);
+            }
+        }
+        else {
+            reindex({}, doc, slot);
+        }
+    }
+
+    void Collection::Index::remove(const ValueType& doc, uint32_t slot) {
+        if(compound) {
+            std::vector<Value> key;
+            if(compoundKey(doc, key)) {
+                eraseCounted(compound_index, {std::move(key), slot}, distinct);
+            }
+        }
+        else {
+            std::vector<Value> before;
+            keys(doc, before);
+            rekey(before, {}, slot);
+        }
+    }
+
+    void Collection::Index::reindex(const std::vector<Value>& before, 
+            const ValueType& doc, uint32_t slot) {
+        auto v = field.Get(doc);
+        if(v && v->IsArray()) {
+            multikey = true;
+        }
+        std::vector<Value> after;
+        keys(doc, after);
+        rekey(before, after, slot);
+    }
+
+    void Collection::Index::rekey(const std::vector<Value>& before, 
+            const std::vector<Value>& after, uint32_t slot) {
+        if(kind == INDEX_HASH) {
+            // different values in an array can have the same hash
+            auto keyHashes = [](const std::vector<Value>& vals) {
+                std::vector<uint32_t> hashes;
+                for(auto& val : vals) {
+                    uint32_t h;
+                    if(hashValue(val, h)) {
+                        hashes.push_back(h);
+                    }
+                }
+                std::sort(hashes.begin(), hashes.end());
+                hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+                return hashes;
+            };
+            auto hb = keyHashes(before);
+            auto ha = keyHashes(after);
+            for(auto h : hb) {
+                if(!std::binary_search(ha.begin(), ha.end(), h) && hash.erase(h, slot)) {
+                    distinct--;
+                }
+            }
+            for(auto h : ha) {
+                if(!std::binary_search(hb.begin(), hb.end(), h) && hash.insert(h, slot)) {
+                    distinct++;
+                }
+            }
+            return;
+        }
+
+        // both lists are sorted
+        for(auto& val : before) {
+            if(!std::binary_search(after.begin(), after.end(), val)) {
+                eraseCounted(index, {val, slot}, distinct);
+            }
+        }
+        for(auto& val : after) {
+            if(!std::binary_search(before.begin(), before.end(), val)) {
+                insertCounted(index, {val, slot}, distinct);
+            }
+        }
+    }
+
+    void Collection::Index::clear() {
+        distinct = 0;
+        compound_index.clear();
+        index.clear();
+        hash.clear();
+    }
+
+    void Collection::hashLookup(const Index& idx, const Value& val, 
+            std::vector<uint32_t>& matched) const {
+        uint32_t h;
+        if(!Index::hashValue(val, h)) {
             return;
         }
+        idx.hash.forEach(h, [&](uint32_t slot) {
+            // different values can have the same hash, so check the document
+            uint32_t domIdx;
+            if(domIndexFromSlot(slot, domIdx) && idx.matches(dom[domIdx], val)) {
+                matched.push_back(slot);
+            }
+        });
+        std::sort(matched.begin(), matched.end());
+    }
+
+    void Collection::assignSlots() {
+        auto n = dom.Size();
+        slots.resize(n);
+        for(uint32_t i = 0; i < n; i++) {
+            slots[i] = i;
+        }
+        next_slot = n;
+        generation++;
+    }
+
+    bool Collection::domIndexFromSlot(uint32_t slot, uint32_t& domIdx) const {
+        uint32_t L = 0;
+        uint32_t R = logicalSize();
+        while(L < R) {
+            uint32_t m = (L+R)/2;
+            if((slots[physicalIndex(m)] & ~TOMBSTONE) < slot) {
+                L = m+1;
+            }
+            else {
+                R = m;
+            }
+        }
+
+        if(L < logicalSize()) {
+            uint32_t p = physicalIndex(L);
+            if(slots[p] == slot) {
+                domIdx = p;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t Collection::physicalIndex(uint32_t logicalIdx) const {
+        if(logicalIdx < compact_write) {
+            return logicalIdx;
+        }
+        return logicalIdx + (compact_read - compact_write);
+    }
+
+    uint32_t Collection::logicalSize() const {
+        return dom.Size() - (compact_read - compact_write);
+    }
+
+    void Collection::markTombstone(uint32_t domIdx) {
+        generation++;
+        removeDomIdxFromIndex(domIdx);
+        slots[domIdx] |= TOMBSTONE;
+        tombstones++;
+
+        // the compactor will find it if it hasn't got that far yet. 
+        // otherwise, remember where the next pass should start.
+        if(!(compacting && (domIdx >= compact_read))) {
+            first_tombstone = std::min(first_tombstone, domIdx);
+        }
+    }
+
+    void Collection::setCompactionBudget(uint32_t budget) {
+        compaction_budget = budget;
+    }
+
+    uint32_t Collection::compactTombstones(uint32_t budget) {
+        while(budget > 0) {
+            if(!compacting) {
+                if(tombstones == 0) {
+                    break;
+                }
+                compacting = true;
+                compact_write = compact_read = first_tombstone;
+                first_tombstone = UINT32_MAX;
+            }
+
+            // slide the live documents down over the tombstones
+            uint32_t n = dom.Size();
+            while((budget > 0) && (compact_read < n)) {
+                budget--;
+                if(slots[compact_read] & TOMBSTONE) {
+                    tombstones--;
+                }
+                else {
+                    if(compact_write != compact_read) {
+                        dom[compact_write] = dom[compact_read]; // moves the value
+                        slots[compact_write] = slots[compact_read];
+                        slots[compact_read] |= TOMBSTONE;
+                    }
+                    compact_write++;
+                }
+                compact_read++;
+            }
 
-        auto& arr = doc[name.c_str()];
+            // the pass has finished and the gap is at the end of the array
+            if(compact_read == n) {
+                dom.Erase(dom.Begin() + compact_write, dom.End());
+                slots.resize(compact_write);
+                compact_write = compact_read = 0;
+                compacting = false;
+            }
+        }
+        return tombstones;
+    }
+
+    void Collection::mergeAndReindex(uint32_t domIdx, ValueType& update) {
+        generation++;
+        ValueType& doc = dom[domIdx];
+        uint32_t slot = slots[domIdx];
+
+        // note the indexed values before the merge. compound entries are 
+        // simply removed and added again.
+        auto n = indices.size();
+        std::vector<std::vector<Value>> before(n);
+        for(size_t i = 0; i < n; i++) {
+            if(indices[i]->compound) {
+                indices[i]->remove(doc, slot);
+            }
+            else {
+                indices[i]->keys(doc, before[i]);
+            }
+        }
+
+        mergeObjects(doc, update);
+
+        // only the entries of values that have changed are moved
+        for(size_t i = 0; i < n; i++) {
+            if(indices[i]->compound) {
+                indices[i]->add(doc, slot);
+            }
+            else {
+                indices[i]->reindex(before[i], doc, slot);
+            }
+        }
+    }
+
+    void Collection::indexNewDoc() {
+        ValueType& newdoc = dom[dom.Size()-1];
+
+        for(auto& idx : indices) {
+            idx->add(newdoc, slots.back());
+        }
+    }
+
+
+    void Collection::append(ValueType& d) {
+        // d may belong to another allocator, so copy it into the pool
+        ValueType newdoc(d, allocator);
+        insertNewDoc(newdoc);
+    }
+
+    void Collection::insertNewDoc(ValueType& d) {
+        if(d.IsObject() == false) {
+            cout << "Spino Error: document is not an object" << endl;
+            return;
+        }
 
         // check if _id exists already
         // normally, if this exists its because the journal is being consolidated
@@ -113,15 +539,25 @@ namespace Spino {
             last_append_timestamp = timestamp;
 
             ValueType _id;
-            _id.SetString(idstr, 16, doc.GetAllocator());
+            _id.SetString(idstr, 16, allocator);
 
 
-            d.AddMember("_id", _id, doc.GetAllocator());
+            d.AddMember("_id", _id, allocator);
         }
 
 
-        arr.PushBack(d.GetObject(), doc.GetAllocator());
+        // slot numbers must stay ordered. if they've run out, the documents
+        // are renumbered and the indices rebuilt. this is extremely rare.
+        if(next_slot == TOMBSTONE) {
+            compactTombstones();
+            assignSlots();
+            reconstructIndices();
+        }
+
+        dom.PushBack(d, allocator);
+        slots.push_back(next_slot++);
         indexNewDoc();
+        generation++;
 
 
         if(jw.getEnabled()) {
@@ -132,19 +568,22 @@ namespace Spino {
 
             rapidjson::StringBuffer sb;
             rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
-            arr[arr.Size()-1].Accept(writer);
+            dom[dom.Size()-1].Accept(writer);
             ss << escape(sb.GetString()) << "\"}";
 
             jw.append(ss.str());
         }
+
+        compactTombstones(compaction_budget);
     }
 
     void Collection::append(const char* s) {
-        DocType d;
+        // parse straight into the pool so the document doesn't need copying
+        DocType d(&allocator);
         d.Parse(s);
         if(d.HasParseError() == false) {
             if(d.IsObject()) {
-                append(d.GetObject());
+                insertNewDoc(d);
             }
             else {
                 cout << "Spino Error: document is not an object" << endl;
@@ -157,29 +596,14 @@ namespace Spino {
     }
 
     void Collection::updateById(const char* id_cstr, const char* update) {
-        auto& arr = doc[name.c_str()];
         uint32_t domIdx;
         if(domIndexFromId(id_cstr, domIdx)) {
             DocType j;
             j.Parse(update);
 
             if(j.HasParseError() == false) {
-                mergeObjects(arr[domIdx], j.GetObject());
-                hashmap.clear();
-                if(jw.getEnabled()) {
-                    stringstream ss;
-                    ss << "{\"cmd\":\"updateById\",\"collection\":\"";
-                    ss << escape(name);
-                    ss << "\",\"id\":\"" << id_cstr;
-                    ss << "\",\"document\":\"";
-
-                    rapidjson::StringBuffer sb;
-                    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
-                    j.Accept(writer);
-                    ss << escape(sb.GetString()) << "\"}";
-
-                    jw.append(ss.str());
-                }
+                mergeAndReindex(domIdx, j);
+                journalUpdateById(id_cstr, j);
             }
             else {
                 cout << "Spino Error:: updateById: could not parse json document" << endl;
@@ -187,10 +611,11 @@ namespace Spino {
             }
         } else {
         }
+
+        compactTombstones(compaction_budget);
     }
 
     void Collection::update(const char* search, const char* update) {
-        auto& arr = doc[name.c_str()];
         DocType j;
         j.Parse(update);
         if(j.HasParseError()) {
@@ -199,24 +624,73 @@ namespace Spino {
             return;
         }
 
-        Spino::QueryParser parser(search);
-        std::shared_ptr<QueryNode> block;
+        std::shared_ptr<const ParsedQuery> query;
         try {
-            block = parser.parse_expression();
+            query = query_cache.get(search);
         }
         catch(parse_error& e) {
             cout << "SpinoDB:: query parse error: " << e.what() << endl;
             return;
         }
 
+        // replaying the journal runs the query again, so the changes it 
+        // makes aren't journalled one at a time
+        bool prior = jw.getEnabled();
+        jw.setEnabled(false);
+        updateMatching(*query, j, update);
+        jw.setEnabled(prior);
+
+        if(jw.getEnabled()) {
+            stringstream ss;
+            ss << "{\"cmd\":\"update\",\"collection\":\"";
+            ss << escape(name);
+            ss << "\",\"query\":\"" << escape(search);
+            ss << "\",\"document\":\"";
+
+            rapidjson::StringBuffer sb;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+            j.Accept(writer);
+            ss << escape(sb.GetString()) << "\"}";
+
+            jw.append(ss.str());
+        }
+
+        compactTombstones(compaction_budget);
+    }
+
+    void Collection::update(const PreparedQuery& query, const char* update) {
+        // nothing would match, so the update would be added as a new document
+        if(!query.isBound()) {
+            cout << "Spino Error:: update: the prepared query has placeholders that haven't been bound" << endl;
+            return;
+        }
+
+        DocType j;
+        j.Parse(update);
+        if(j.HasParseError()) {
+            cout << "Spino Error:: update: could not parse json document" << endl;
+            cout << update << endl;
+            return;
+        }
 
+        // the query text has placeholders instead of values, so each
+        // document that is changed is journalled by its id
+        updateMatching(*query.getQuery(), j, update);
+
+        compactTombstones(compaction_budget);
+    }
+
+    void Collection::updateMatching(const ParsedQuery& query, DocType& j, const char* update) {
         bool updated = false;
-        if(arr.IsArray()) {
-            for (ValueType::ValueIterator itr = arr.Begin();
-                    itr != arr.End(); ++itr) {
-                Spino::QueryExecutor exec(&(*itr));
-                if(exec.resolve(block)) {
-                    mergeObjects(*itr, j.GetObject());
+        if(dom.IsArray()) {
+            uint32_t n = dom.Size();
+            for(uint32_t i = 0; i < n; i++) {
+                if(!isLive(i)) {
+                    continue;
+                }
+                if(query.program.matches(dom[i])) {
+                    mergeAndReindex(i, j);
+                    journalUpdateById(dom[i]["_id"].GetString(), j);
                     updated = true;
                 } 
             }
@@ -226,11 +700,18 @@ namespace Spino {
                 << name << " is not an array. DOM corrupted." << endl;
         }
 
+        // nothing matched, so the update is added as a new document
+        if(updated == false) {
+            append(update);
+        }
+    }
+
+    void Collection::journalUpdateById(const char* id, DocType& j) {
         if(jw.getEnabled()) {
             stringstream ss;
-            ss << "{\"cmd\":\"update\",\"collection\":\"";
+            ss << "{\"cmd\":\"updateById\",\"collection\":\"";
             ss << escape(name);
-            ss << "\",\"query\":\"" << escape(search);
+            ss << "\",\"id\":\"" << id;
             ss << "\",\"document\":\"";
 
             rapidjson::StringBuffer sb;
@@ -240,51 +721,15 @@ namespace Spino {
 
             jw.append(ss.str());
         }
-
-        if(updated == false) {
-            bool prior = jw.getEnabled();
-            jw.setEnabled(false);
-            append(update);
-            jw.setEnabled(prior);
-        }
-
-        hashmap.clear();
     }
 
-    void Collection::createIndex(const char* s) {
-        auto& arr = doc[name.c_str()];
-        auto idx = new Collection::Index();
-        idx->field_name = s;
-        stringstream ss(s);
-        string intermediate;
-        string ptr;
-        while(getline(ss, intermediate, '.')) {
-            ptr += "/" + intermediate;
-        }
-        idx->field = PointerType(ptr.c_str());
-
-        auto n = arr.Size();
+    void Collection::createIndex(const char* s, IndexKind kind) {
+        auto idx = new Collection::Index(s, kind);
 
+        auto n = dom.Size();
         for(uint32_t i = 0; i < n; i++) {
-            ValueType& doc = arr[i].GetObject();
-            auto v = idx->field.Get(doc);
-
-            if(v != nullptr) {
-                // only add string and number values to the index
-                if(v->IsString()) {
-                    Value val;
-                    val.type = TYPE_STRING;
-                    val.str = v->GetString();
-                    idx->index.insert({val, i});
-                }
-                else if(v->IsNumber()) {
-                    Value val;
-                    val.type = TYPE_NUMERIC;
-                    val.numeric = v->GetDouble();
-                    idx->index.insert({val, i});
-                } else {
-                    // can't index objects or arrays, etc
-                }
+            if(isLive(i)) {
+                idx->add(dom[i], slots[i]);
             }
         }
 
@@ -309,38 +754,34 @@ namespace Spino {
     std::string Collection::findOneById(const char* id_cstr) const {
         uint32_t m;
         if(domIndexFromId(id_cstr, m)) {
-            auto& list = doc[name.c_str()];
             rapidjson::StringBuffer sb;
             rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
-            list[m].Accept(writer);
+            dom[m].Accept(writer);
             return sb.GetString();
         }
         return "";
     }
 
     bool Collection::domIndexFromId(const char* id_cstr, uint32_t& domIdx) const {
-        auto& arr = doc[name.c_str()];
         uint64_t tsc = fast_atoi_len(id_cstr, 10);
         uint64_t countc = fast_atoi_len(&id_cstr[10], 6);
 
-        auto n = arr.Size();
-        auto R = n-1;
+        // binary search over the logical positions so that documents 
+        // currently being moved by the compactor are skipped
         uint32_t L = 0;
-        while(L <= R) {
+        uint32_t R = logicalSize();
+        while(L < R) {
             auto m = (L+R)/2;
+            auto p = physicalIndex(m);
 
-            if(m > arr.Size()-1) {
-                return false;
-            }
-
-            const char* id_to_test = arr[m].GetObject()["_id"].GetString();
+            const char* id_to_test = dom[p].GetObject()["_id"].GetString();
             uint64_t timestamp = fast_atoi_len(id_to_test, 10);
 
             if(timestamp < tsc) {
                 L = m+1;
             }
             else if(timestamp > tsc) {
-                R = m-1;
+                R = m;
             }
             else {
                 uint64_t count = fast_atoi_len(&id_to_test[10], 6);
@@ -348,175 +789,455 @@ namespace Spino {
                     L = m+1;
                 } 
                 else if(count > countc) {
-                    R = m-1;
+                    R = m;
                 }
                 else {
-                    domIdx = m;
-                    return true;
+                    domIdx = p;
+                    return isLive(p);
                 }
             }
         }
         return false;
     }
 
+    void Collection::positionAfterId(const char* id_cstr, uint32_t& domIdx, uint32_t& slot) const {
+        uint64_t tsc = fast_atoi_len(id_cstr, 10);
+        uint64_t countc = fast_atoi_len(&id_cstr[10], 6);
+
+        uint32_t L = 0;
+        uint32_t R = logicalSize();
+        while(L < R) {
+            auto m = (L+R)/2;
+            const char* id_to_test = dom[physicalIndex(m)].GetObject()["_id"].GetString();
+            uint64_t timestamp = fast_atoi_len(id_to_test, 10);
+            if((timestamp < tsc) || 
+                    ((timestamp == tsc) && (fast_atoi_len(&id_to_test[10], 6) <= countc))) {
+                L = m+1;
+            }
+            else {
+                R = m;
+            }
+        }
+
+        if(L < logicalSize()) {
+            domIdx = physicalIndex(L);
+            slot = slots[domIdx] & ~TOMBSTONE;
+        }
+        else {
+            domIdx = dom.Size();
+            slot = next_slot;
+        }
+    }
+
     std::string Collection::findOne(const char* s) {
-        std::string v; //result
+        // queries that don't match anything are cached too
+        std::string key = std::string("findOne:") + s;
+        auto cached = result_cache.get(key, generation);
+        if(cached) {
+            return cached->text;
+        }
+
+        //search with the best plan find() can come up with
+        BaseCursor* cursor = find(s);
+        std::string v = cursor->next();
+        delete cursor;
+
+        result_cache.put({key, generation, v, {}});
+        return v;
+    }
 
-        //check hashmap for existing query results
-        std::string str = s;
-        auto hash = fnv1a_hash(str);
-        auto it = hashmap.find(hash);
-        if (it != hashmap.end()) {
-            return it->second;
+    void Collection::cacheMatches(const std::string& key, uint64_t gen, 
+            std::vector<uint32_t>&& matches) const {
+        if(gen == generation) {
+            result_cache.put({key, gen, "", std::move(matches)});
         }
+    }
 
-        //check if it's an index search
-        QueryParser parser(s);
-        std::shared_ptr<BasicFieldComparison> bfc = nullptr;
+    BaseCursor* Collection::find(const char* s) const {
+        auto begin = std::chrono::steady_clock::now();
+
+        // a scan that found every match of the query before the last
+        // write left their slots in the result cache
+        std::string key = std::string("find:") + s;
+        auto cached = result_cache.get(key, generation);
+        if(cached) {
+            std::vector<uint32_t> matches = cached->slots;
+            BaseCursor* cursor = new SlotCursor(std::move(matches), *this);
+            std::chrono::duration<double, std::micro> t = std::chrono::steady_clock::now() - begin;
+            cursor->setPlan("resultCache", {}, t.count());
+            return cursor;
+        }
+
+        uint64_t misses = query_cache.getMisses();
+        std::shared_ptr<const ParsedQuery> query;
         try {
-            bfc = parser.parse_basic_comparison();
+            query = query_cache.get(s);
         }
         catch(parse_error& err) {
             cout << "SpinoDB:: parse error: " << err.what() << endl;
-            return "";
+            return new DudCursor();
         }
+        std::chrono::duration<double, std::micro> t = std::chrono::steady_clock::now() - begin;
 
-        if(bfc != nullptr) {
-            for(auto idx : indices) {
-                if(idx->field_name == bfc->field_name) {
-                    auto iter = idx->index.find(bfc->v);
-                    if(iter != idx->index.end()) {
-                        auto n = iter->second;
+        BaseCursor* cursor = find(query);
+        cursor->setParseTime(t.count(), query_cache.getMisses() == misses);
+        if(auto linear = dynamic_cast<LinearCursor*>(cursor)) {
+            linear->recordMatches(key, generation);
+        }
+        return cursor;
+    }
 
-                        rapidjson::StringBuffer sb;
-                        rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
-                        doc[name.c_str()][n].Accept(writer);
-                        v = sb.GetString();
-                    }
-                    break;
+    BaseCursor* Collection::find(const PreparedQuery& query) const {
+        // prepared queries were parsed when they were made
+        BaseCursor* cursor = find(query.getQuery());
+        cursor->setParseTime(0, true);
+        return cursor;
+    }
+
+    std::string Collection::findOne(const PreparedQuery& query) {
+        // results of prepared queries aren't cached because the bindings
+        // change without the query text changing
+        BaseCursor* cursor = find(query);
+        std::string v = cursor->next();
+        delete cursor;
+        return v;
+    }
+
+    BaseCursor* Collection::find(std::shared_ptr<const ParsedQuery> query) const {
+        // the time it takes to choose a plan counts towards running the query
+        auto begin = std::chrono::steady_clock::now();
+        auto planned = [&](BaseCursor* cursor, const char* plan, 
+                const std::vector<std::string>& used) {
+            std::chrono::duration<double, std::micro> t = std::chrono::steady_clock::now() - begin;
+            cursor->setPlan(plan, used, t.count());
+            return cursor;
+        };
+
+        //check if it's an index search. a placeholder that isn't bound
+        //to a string or number can't be looked up in an index
+        auto& bfc = query->bfc;
+
+
+        if((bfc != nullptr) && ((bfc->v.type == TYPE_NUMERIC) || (bfc->v.type == TYPE_STRING))) {
+            for(auto& idx : indices) {
+                if((idx->field_name == bfc->field_name) && (idx->kind == INDEX_HASH)) {
+                    std::vector<uint32_t> matched;
+                    hashLookup(*idx, bfc->v, matched);
+                    return planned(new SlotCursor(std::move(matched), *this), 
+                            "hashLookup", {idx->field_name});
+                }
+                else if(idx->field_name == bfc->field_name) {
+                    IndexIteratorRange range(
+                            idx->index.lower_bound({bfc->v, 0}),
+                            idx->index.upper_bound({bfc->v, UINT32_MAX}));
+                    return planned(new RangeIndexCursor(range, *this, bfc->field_name), 
+                            "indexRange", {idx->field_name});
                 }
             }
         }
 
-        //if it's not an index search, do a linear search using a cursor
-        if(v == "") {
-            LinearCursor cursor(doc[name.c_str()], s);
-            v = cursor.next();
+        auto& head = query->head;
+        IndexIteratorRange range;
+        if(indexRange(head, range)) {
+            auto field = std::dynamic_pointer_cast<Field>(head);
+            return planned(new RangeIndexCursor(range, *this, field->field_name), 
+                    "indexRange", {field->field_name});
         }
 
-        //if there is a result, add it to the hashmap for future reference
-        if(v != "") {
-            hashmap[hash] = v;
+        // let the planner look for indices in $and and $or queries.
+        // the candidates it finds are checked against the whole query.
+        std::vector<uint32_t> candidates;
+        QueryPlanner planner(*this);
+        if(planner.plan(head, candidates)) {
+            auto cursor = new SlotCursor(std::move(candidates), *this, query);
+            CompoundIteratorRange keys;
+            auto idx = planner.keyRange(keys);
+            if(idx) {
+                cursor->setKeyRange(keys, idx->field_names);
+            }
+            return planned(cursor, "indexCandidates", planner.indicesUsed());
         }
 
-        return v;
+        return planned(new LinearCursor(*this, query), "collectionScan", {});
     }
 
-    /**
-     * fnv-1a is a very fast hashing algorithm with low collision rates
-     * at least, that's what the internet told me
-     */
-    uint32_t Collection::fnv1a_hash(std::string& s) {
-        auto length = s.length()+1;
-        unsigned int hash = OFFSET_BASIS;
-        for (size_t i = 0; i < length; ++i)
-        {
-            hash ^= s[i]++;
-            hash *= FNV_PRIME;
+    std::string Collection::distinct(const char* field_name) const {
+        rapidjson::StringBuffer sb;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+        auto write = [&](const Value& v) {
+            if(v.type == TYPE_STRING) {
+                writer.String(v.str.c_str(), v.str.size());
+            }
+            else if((fabs(v.numeric) < 9007199254740992.0) && (v.numeric == (int64_t)v.numeric)) {
+                writer.Int64((int64_t)v.numeric);
+            }
+            else {
+                writer.Double(v.numeric);
+            }
+        };
+
+        writer.StartArray();
+        auto index = orderedIndex(field_name);
+        if(index) {
+            // jump from each key to the first entry of the next one
+            auto iter = index->begin();
+            while(iter != index->end()) {
+                write(iter->first);
+                iter = index->upper_bound({iter->first, UINT32_MAX});
+            }
         }
-        return hash;
+        else {
+            PointerType field = pointerFromFieldName(field_name);
+            std::set<Value> values;
+            for(uint32_t i = 0; i < dom.Size(); i++) {
+                auto v = isLive(i) ? field.Get(dom[i]) : nullptr;
+                Value val;
+                if(v && v->IsArray()) {
+                    // arrays give each of their values, like a multikey index
+                    for(auto& elem : v->GetArray()) {
+                        if(scalarKey(elem, val)) {
+                            values.insert(val);
+                        }
+                    }
+                }
+                else if(v && scalarKey(*v, val)) {
+                    values.insert(std::move(val));
+                }
+            }
+            for(auto& value : values) {
+                write(value);
+            }
+        }
+        writer.EndArray();
+        return sb.GetString();
     }
 
-    BaseCursor* Collection::find(const char* s) const {
-        //check if it's an index search
-        QueryParser parser(s);
-        std::shared_ptr<BasicFieldComparison> bfc = nullptr;
+    std::string Collection::aggregate(const char* text) const {
         try {
-            bfc = parser.parse_basic_comparison();
+            Pipeline pipeline(text, query_cache);
+
+            // the documents for the first $match are found like a find()
+            std::vector<const ValueType*> docs;
+            auto query = pipeline.firstMatch();
+            if(query) {
+                BaseCursor* cursor = find(query);
+                while(cursor->hasNext()) {
+                    docs.push_back(&cursor->nextAsJsonObj());
+                }
+                delete cursor;
+            }
+            else {
+                docs.reserve(size());
+                for(uint32_t i = 0; i < dom.Size(); i++) {
+                    if(isLive(i)) {
+                        docs.push_back(&dom[i]);
+                    }
+                }
+            }
+            return pipeline.run(*this, docs);
         }
         catch(parse_error& err) {
-            cout << "SpinoDB:: parse error: " << err.what() << endl;
-            return new DudCursor();
+            cout << "SpinoDB:: aggregate error: " << err.what() << endl;
+            return "[]";
         }
+    }
 
+    const uint32_t Collection::SCAN_BLOCK;
+    const uint32_t Collection::SCAN_BLOCK_MAX;
+
+    uint32_t Collection::scanTasks(uint32_t n) const {
+        // each task gets at least a few thousand documents, otherwise 
+        // waking the threads costs more than it saves. there are a few 
+        // tasks per thread so a slow one can be balanced out.
+        const uint32_t min_task = 4096;
+        uint32_t threads = pool.getThreads();
+        if(threads < 2) {
+            return 1;
+        }
+        return std::max(1u, std::min(threads * 4, n / min_task));
+    }
 
-        if(bfc != nullptr) {
-            for(auto& idx : indices) {
-                if(idx->field_name == bfc->field_name) {
-                    auto range = idx->index.equal_range(bfc->v);
-                    return new EqIndexCursor(range, doc[name.c_str()]);
+    void Collection::scan(const QueryProgram& program, uint32_t begin, uint32_t end, 
+            std::vector<uint32_t>& matched) const {
+        uint32_t n_tasks = scanTasks(end - begin);
+        if(n_tasks < 2) {
+            for(uint32_t i = begin; i < end; i++) {
+                if(isLive(i) && program.matches(dom[i])) {
+                    matched.push_back(i);
                 }
             }
+            return;
         }
 
-        return new LinearCursor(doc[name.c_str()], s);
+        // each task keeps its own list so they can be joined in order
+        std::vector<std::vector<uint32_t>> parts(n_tasks);
+        uint32_t step = (end - begin + n_tasks - 1) / n_tasks;
+        pool.run(n_tasks, [&](uint32_t t) {
+            uint32_t from = std::min(end, begin + t*step);
+            uint32_t to = std::min(end, from + step);
+            for(uint32_t i = from; i < to; i++) {
+                if(isLive(i) && program.matches(dom[i])) {
+                    parts[t].push_back(i);
+                }
+            }
+        });
+
+        for(auto& part : parts) {
+            matched.insert(matched.end(), part.begin(), part.end());
+        }
     }
 
-    void Collection::removeDomIdxFromIndex(uint32_t domIdx) {
-        for(auto idx : indices) {
-            std::vector<std::pair<Spino::Value, int>> idx_copies;
-            auto iitr = idx->index.begin();
-            while(iitr != idx->index.end()) {
-                auto entry = *iitr;
-                if(entry.second == domIdx) {
-                    iitr = idx->index.erase(iitr);
-                } 
-                else if(entry.second > domIdx) {
-                    idx_copies.push_back({iitr->first, iitr->second-1});
-                    iitr = idx->index.erase(iitr);
-                }
-                else {	
-                    iitr++;
+    uint32_t Collection::scanCount(const QueryProgram& program) const {
+        uint32_t n = dom.Size();
+        uint32_t n_tasks = scanTasks(n);
+        std::vector<uint32_t> counts(n_tasks, 0);
+        uint32_t step = (n + n_tasks - 1) / n_tasks;
+        pool.run(n_tasks, [&](uint32_t t) {
+            uint32_t from = std::min(n, t*step);
+            uint32_t to = std::min(n, from + step);
+            uint32_t r = 0;
+            for(uint32_t i = from; i < to; i++) {
+                if(isLive(i) && program.matches(dom[i])) {
+                    r++;
                 }
             }
+            counts[t] = r;
+        });
+
+        uint32_t r = 0;
+        for(auto c : counts) {
+            r += c;
+        }
+        return r;
+    }
+
+    bool Collection::indexRange(std::shared_ptr<QueryNode> node, IndexIteratorRange& range) const {
+        auto field = std::dynamic_pointer_cast<Field>(node);
+        if((field == nullptr) || (field->operation == nullptr)) {
+            return false;
+        }
+
+        auto op = field->operation->op;
+        if((op != TOK_GREATER_THAN) && (op != TOK_LESS_THAN) &&
+                (op != TOK_GREATER_THAN_EQUAL) && (op != TOK_LESS_THAN_EQUAL) &&
+                (op != TOK_STARTS_WITH)) {
+            return false;
+        }
+
+        // every entry in a prefix range starts with the prefix, so 
+        // the documents don't need to be checked
+        Value v;
+        if(!literalValue(field->operation->cmp, v) || 
+                ((v.type != TYPE_NUMERIC) && (v.type != TYPE_STRING)) ||
+                ((op == TOK_STARTS_WITH) && (v.type != TYPE_STRING))) {
+            return false;
+        }
+
+        // a range of a multikey index can find a document more than 
+        // once, so the planner de-duplicates it instead
+        for(auto& idx : indices) {
+            if((idx->field_name == field->field_name) && (idx->kind == INDEX_ORDERED) && 
+                    !idx->compound && !idx->multikey) {
+                orderedRange(*idx, op, v, range);
+                return true;
+            }
+        }
+        return false;
+    }
 
-            for(auto i : idx_copies) {
-                idx->index.insert(i);
+    const IndexSet* Collection::orderedIndex(const std::string& field_name) const {
+        for(auto idx : indices) {
+            if((idx->kind == INDEX_ORDERED) && !idx->compound && (idx->field_name == field_name)) {
+                return &idx->index;
             }
         }
+        return nullptr;
+    }
+
+    bool Collection::multikeyIndex(const std::string& field_name) const {
+        for(auto idx : indices) {
+            if(!idx->compound && (idx->field_name == field_name) && idx->multikey) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Collection::orderedRange(const Index& idx, int op, const Value& v, 
+            IndexIteratorRange& range) const {
+        // the index is sorted by type and then by value. values of 
+        // other types never match, so the range stops at the first 
+        // and last entries of the same type.
+        Value type_first;
+        type_first.type = v.type;
+        type_first.numeric = -INFINITY;
+        Value type_end;
+        type_end.type = v.type + 1;
+        type_end.numeric = -INFINITY;
+
+        auto& index = idx.index;
+        switch(op) {
+            case TOK_GREATER_THAN:
+                range.first = index.upper_bound({v, UINT32_MAX});
+                range.second = index.lower_bound({type_end, 0});
+                break;
+            case TOK_GREATER_THAN_EQUAL:
+                range.first = index.lower_bound({v, 0});
+                range.second = index.lower_bound({type_end, 0});
+                break;
+            case TOK_LESS_THAN:
+                range.first = index.lower_bound({type_first, 0});
+                range.second = index.lower_bound({v, 0});
+                break;
+            case TOK_LESS_THAN_EQUAL:
+                range.first = index.lower_bound({type_first, 0});
+                range.second = index.upper_bound({v, UINT32_MAX});
+                break;
+            case TOK_STARTS_WITH:
+                {
+                    // strings with the prefix sort before the prefix with 
+                    // its last byte incremented
+                    Value next = v;
+                    while(next.str.size() && ((unsigned char)next.str.back() == 0xff)) {
+                        next.str.pop_back();
+                    }
+                    range.first = index.lower_bound({v, 0});
+                    if(next.str.empty()) {
+                        range.second = index.lower_bound({type_end, 0});
+                    }
+                    else {
+                        next.str.back()++;
+                        range.second = index.lower_bound({next, 0});
+                    }
+                }
+                break;
+        }
+    }
+
+    void Collection::removeDomIdxFromIndex(uint32_t domIdx) {
+        for(auto idx : indices) {
+            idx->remove(dom[domIdx], slots[domIdx]);
+        }
     }
 
     void Collection::reconstructIndices() {
-        auto& arr = doc[name.c_str()];
-        auto n = arr.Size();
+        auto n = dom.Size();
 
         for(auto& idx : indices) {
-            idx->index.clear();
+            idx->clear();
 
             for(uint32_t i = 0; i < n; i++) {
-                ValueType& doc = arr[i].GetObject();
-                auto v = idx->field.Get(doc);
-
-                if(v != nullptr) {
-                    // only add string and number values to the index
-                    if(v->IsString()) {
-                        Value val;
-                        val.type = TYPE_STRING;
-                        val.str = v->GetString();
-                        idx->index.insert({val, i});
-                    }
-                    else if(v->IsNumber()) {
-                        Value val;
-                        val.type = TYPE_NUMERIC;
-                        val.numeric = v->GetDouble();
-                        idx->index.insert({val, i});
-                    } 
+                if(isLive(i)) {
+                    idx->add(dom[i], slots[i]);
                 }
             }
         }
     }
 
     void Collection::dropById(const char* s) {
-        auto& arr = doc[name.c_str()];
         uint32_t domIdx;
         if(domIndexFromId(s, domIdx)) {
-            removeDomIdxFromIndex(domIdx);
-
-            auto iter = arr.Begin();
-            iter += domIdx;
-
-            arr.Erase(iter);
-            hashmap.clear();
+            markTombstone(domIdx);
         }
 
         if(jw.getEnabled()) {
@@ -527,6 +1248,8 @@ namespace Spino {
             ss << "\"}";
             jw.append(ss.str());
         }
+
+        compactTombstones(compaction_budget);
     }
 
 
@@ -535,39 +1258,19 @@ namespace Spino {
     }
 
     uint32_t Collection::drop(const char* j, uint32_t limit) {
-        // TODO
-        // do an index search first
-        //
-        auto& arr = doc[name.c_str()];
-        Spino::QueryParser parser(j);
-        std::shared_ptr<QueryNode> block;
+        std::shared_ptr<const ParsedQuery> query;
         try {
-            block = parser.parse_expression();
+            query = query_cache.get(j);
         }
         catch(parse_error& e) {
             cout << "SpinoDB:: query parse error: " << e.what() << endl;
             return 0;
         }
 
-        uint32_t count = 0;
-        for (ValueType::ConstValueIterator itr = arr.Begin();
-                itr != arr.End(); ) {
-            Spino::QueryExecutor exec(&(*itr));
-            if(exec.resolve(block)) {
-                count++;
-                itr = arr.Erase(itr);
-                if(count >= limit) {
-                    break;
-                } 
-            } else {
-                itr++;
-            }
-        }
-
-        if(count > 0) {
-            hashmap.clear();
-            reconstructIndices();
-        }
+        bool prior = jw.getEnabled();
+        jw.setEnabled(false);
+        uint32_t count = dropMatching(*query, limit);
+        jw.setEnabled(prior);
 
         if(jw.getEnabled()) {
             stringstream ss;
@@ -577,54 +1280,93 @@ namespace Spino {
             ss << "\",\"limit\":" << limit << "}";
             jw.append(ss.str());
         }
+
+        compactTombstones(compaction_budget);
         return count;
     }
 
-    uint32_t Collection::dropOlderThan(uint64_t timestamp) {
-        auto& arr = doc[name.c_str()];
-        timestamp /= 1000; // convert to seconds since epoch
-
-        uint32_t n = arr.Size();
-        if(n == 0) {
+    uint32_t Collection::drop(const PreparedQuery& query, uint32_t limit) {
+        if(!query.isBound()) {
+            cout << "Spino Error:: drop: the prepared query has placeholders that haven't been bound" << endl;
             return 0;
         }
 
-        uint32_t R = n-1;
-        uint32_t L = 0;
-        uint32_t m;
-        // this search fill find the nearest document to the specified timestamp
-        // and anything up to that can be deleted
-        while(L <= R) {
-            m = (L+R)/2;
+        // dropped documents are journalled by their ids
+        uint32_t count = dropMatching(*query.getQuery(), limit);
+        compactTombstones(compaction_budget);
+        return count;
+    }
 
-            if(m > arr.Size()-1) {
-                return 0;
+    uint32_t Collection::dropMatching(const ParsedQuery& query, uint32_t limit) {
+        // TODO
+        // do an index search first
+        //
+        uint32_t count = 0;
+        uint32_t n = dom.Size();
+        auto drop = [&](uint32_t i) {
+            if(jw.getEnabled()) {
+                stringstream ss;
+                ss << "{\"cmd\":\"dropById\",\"collection\":\"";
+                ss << escape(name);
+                ss << "\",\"id\":\"" << escape(dom[i]["_id"].GetString());
+                ss << "\"}";
+                jw.append(ss.str());
             }
+            markTombstone(i);
+            count++;
+        };
+
+        if(scanThreads() > 1) {
+            // match in parallel, a block at a time so a limit doesn't scan
+            // the whole collection, then drop in order on this thread
+            std::vector<uint32_t> matched;
+            uint32_t block = SCAN_BLOCK;
+            for(uint32_t i = 0; (i < n) && (count < limit); i += block, block *= 2) {
+                block = std::min(block, SCAN_BLOCK_MAX);
+                matched.clear();
+                scan(query.program, i, std::min(n, i + block), matched);
+                for(size_t m = 0; (m < matched.size()) && (count < limit); m++) {
+                    drop(matched[m]);
+                }
+            }
+        }
+        else {
+            for(uint32_t i = 0; (i < n) && (count < limit); i++) {
+                if(isLive(i) && query.program.matches(dom[i])) {
+                    drop(i);
+                }
+            }
+        }
+        return count;
+    }
 
-            const char* id_to_test = arr[m].GetObject()["_id"].GetString();
+    uint32_t Collection::dropOlderThan(uint64_t timestamp) {
+        timestamp /= 1000; // convert to seconds since epoch
+
+        // find the first document that isn't older than the timestamp.
+        // everything before it can be dropped
+        uint32_t L = 0;
+        uint32_t R = logicalSize();
+        while(L < R) {
+            uint32_t m = (L+R)/2;
+            const char* id_to_test = dom[physicalIndex(m)].GetObject()["_id"].GetString();
             uint64_t id_timestamp = fast_atoi_len(id_to_test, 10);
 
             if(id_timestamp < timestamp) {
                 L = m+1;
             }
-            else if(id_timestamp > timestamp) {
-                R = m-1;
-            }
             else {
-                break;
+                R = m;
             }
         }
 
-        if(L > 0) {
-            ValueType::ConstValueIterator itr = arr.Begin();
-            for(uint32_t i = 0; i < L; i++) {
-                itr++;
+        uint32_t count = 0;
+        for(uint32_t i = 0; i < L; i++) {
+            uint32_t p = physicalIndex(i);
+            if(isLive(p)) {
+                markTombstone(p);
+                count++;
             }
-
-            arr.Erase(arr.Begin(), itr);
-
-            hashmap.clear();
-            reconstructIndices();
         }
 
         if(jw.getEnabled()) {
@@ -634,8 +1376,29 @@ namespace Spino {
             ss << "\",\"timestamp\":" << timestamp << "}";
             jw.append(ss.str());
         }
-        return m;
 
+        compactTombstones(compaction_budget);
+        return count;
+    }
+
+    size_t Collection::compact() {
+        compactTombstones();
+        size_t before = allocator.Capacity();
+
+        AllocatorType fresh;
+        ValueType copy(dom, fresh);
+        dom.Swap(copy);
+
+        // the indices don't point into the DOM, so they're still valid.
+        // replacing the allocator drops the last reference to the old pool.
+        allocator = fresh;
+
+        size_t after = allocator.Capacity();
+        return (before > after) ? (before - after) : 0;
+    }
+
+    size_t Collection::memoryUsage() const {
+        return allocator.Size();
     }
 
     bool Collection::mergeObjects(ValueType& dstObject, ValueType& srcObject)
@@ -646,13 +1409,13 @@ namespace Spino {
             if (dstIt == dstObject.MemberEnd())
             {
                 ValueType dstName ;
-                dstName.CopyFrom(srcIt->name, doc.GetAllocator());
+                dstName.CopyFrom(srcIt->name, allocator);
                 ValueType dstVal ;
-                dstVal.CopyFrom(srcIt->value, doc.GetAllocator());
+                dstVal.CopyFrom(srcIt->value, allocator);
 
-                dstObject.AddMember(dstName, dstVal, doc.GetAllocator());
+                dstObject.AddMember(dstName, dstVal, allocator);
 
-                dstName.CopyFrom(srcIt->name, doc.GetAllocator());
+                dstName.CopyFrom(srcIt->name, allocator);
                 dstIt = dstObject.FindMember(dstName);
 
                 if (dstIt == dstObject.MemberEnd()) {
@@ -671,8 +1434,8 @@ namespace Spino {
                     for (auto arrayIt = srcIt->value.Begin(); arrayIt != srcIt->value.End(); ++arrayIt)
                     {
                         ValueType dstVal ;
-                        dstVal.CopyFrom(*arrayIt, doc.GetAllocator()) ;
-                        dstIt->value.PushBack(dstVal, doc.GetAllocator());
+                        dstVal.CopyFrom(*arrayIt, allocator) ;
+                        dstIt->value.PushBack(dstVal, allocator);
                     }
                 }
                 else if (srcIt->value.IsObject())
@@ -682,7 +1445,7 @@ namespace Spino {
                 }
                 else
                 {
-                    dstIt->value.CopyFrom(srcIt->value, doc.GetAllocator()) ;
+                    dstIt->value.CopyFrom(srcIt->value, allocator) ;
                 }
             }
         }
@@ -24,18 +24,33 @@
 
 #include "Cursor.h"
 #include "Journal.h"
+#include "HashIndex.h"
+#include "PreparedQuery.h"
+#include "ThreadPool.h"
+#include "ResultCache.h"
 
 namespace Spino
 {
+    class QueryPlanner;
+
+    // ordered indices support every query that uses an index. 
+    // hash indices only support equality but are faster and smaller.
+    enum IndexKind {
+        INDEX_ORDERED,
+        INDEX_HASH
+    };
 
     class Collection {
         public:
-            Collection(DocType& doc, JournalWriter& jw, std::string name);
+            Collection(JournalWriter& jw, QueryCache& query_cache, ThreadPool& pool, 
+                    std::string name);
+            Collection(JournalWriter& jw, QueryCache& query_cache, ThreadPool& pool, 
+                    std::string name, const ValueType& documents);
             ~Collection();
 
             std::string getName() const;
 
-            void createIndex(const char* field);
+            void createIndex(const char* field, IndexKind kind = INDEX_ORDERED);
             void dropIndex(const char* field);
 
             void append(ValueType& d);
@@ -51,33 +66,206 @@ namespace Spino
             void dropById(const char* s);
             void dropOne(const char* s);
             uint32_t drop(const char* s, uint32_t limit = UINT32_MAX);
+            uint32_t drop(const PreparedQuery& query, uint32_t limit = UINT32_MAX);
+
+            // prepared queries skip parsing. documents that a prepared 
+            // update or drop changes are journalled by id.
+            void update(const PreparedQuery& query, const char* update);
+            std::string findOne(const PreparedQuery& query);
+            BaseCursor* find(const PreparedQuery& query) const;
+
+            // gets the distinct string and number values of a field as a 
+            // JSON array, strings first and then in ascending order. an 
+            // ordered index on the field is read without the documents.
+            std::string distinct(const char* field_name) const;
+
+            // runs an aggregation pipeline and returns the results as a 
+            // JSON array. the first stage uses an index if it can.
+            std::string aggregate(const char* pipeline) const;
+
             uint32_t dropOlderThan(uint64_t timestamp); //milliseconds since 1970 epoch
 
             static uint64_t timestampById(const char* id);
 
-            uint32_t size() {
-                auto& arr = doc[name.c_str()];
-                return arr.Size();
+            uint32_t size() const {
+                return dom.Size() - (compact_read - compact_write) - tombstones;
+            }
+
+            // the DOM may contain dropped documents that haven't been 
+            // compacted yet. use isLive() to skip over them.
+            const ValueType& getDom() const {
+                return dom;
+            }
+
+            bool isLive(uint32_t domIdx) const {
+                return (slots[domIdx] & TOMBSTONE) == 0;
+            }
+
+            // appends the DOM positions of the live documents in [begin, end) 
+            // that match the program, in order. if the database has more 
+            // than one scan thread, the range is split between them.
+            void scan(const QueryProgram& program, uint32_t begin, uint32_t end, 
+                    std::vector<uint32_t>& matched) const;
+            uint32_t scanCount(const QueryProgram& program) const;
+            uint32_t scanThreads() const { return pool.getThreads(); }
+
+            // the number of tasks to split n documents into for the scan 
+            // threads, and runs f(task) for each of them across the threads
+            uint32_t scanTasks(uint32_t n) const;
+            void runTasks(uint32_t n_tasks, const std::function<void(uint32_t)>& f) const {
+                pool.run(n_tasks, f);
+            }
+
+            // parallel scans match documents a block at a time. blocks start
+            // small so findOne and limits stop early, and double in size.
+            static const uint32_t SCAN_BLOCK = 16384;
+            static const uint32_t SCAN_BLOCK_MAX = 1 << 20;
+
+            // writes the live documents as a JSON array
+            template <typename Writer>
+            void writeDocuments(Writer& writer) const {
+                writer.StartArray();
+                uint32_t n = dom.Size();
+                for(uint32_t i = 0; i < n; i++) {
+                    if(isLive(i)) {
+                        dom[i].Accept(writer);
+                    }
+                }
+                writer.EndArray();
             }
 
+            // dropped documents are marked as tombstones and removed later by
+            // the compactor. the budget is the number of documents the compactor
+            // may visit after each write. the default of UINT32_MAX removes
+            // all tombstones before the write returns. a small budget keeps 
+            // write latency flat while a large number of documents are dropped.
+            void setCompactionBudget(uint32_t budget);
+
+            // runs the compactor. returns the number of tombstones remaining.
+            uint32_t compactTombstones(uint32_t budget = UINT32_MAX);
+
+            // findOne() results and the matches of queries that had to scan
+            // the whole collection are cached. every write to the collection
+            // makes the cached results stale. the cache holds about 8MB of
+            // results by default. a size of zero turns it off.
+            void setResultCacheSize(size_t bytes) { result_cache.setCapacity(bytes); }
+            const ResultCache& getResultCache() const { return result_cache; }
+
+            // a scan that found every match of a query leaves its slots here
+            void cacheMatches(const std::string& key, uint64_t generation, 
+                    std::vector<uint32_t>&& matches) const;
+            uint64_t getGeneration() const { return generation; }
+            uint32_t slotAt(uint32_t domIdx) const { return slots[domIdx] & ~TOMBSTONE; }
+
+            // finds the position of a document in the DOM from its slot
+            bool domIndexFromSlot(uint32_t slot, uint32_t& domIdx) const;
+
+            // finds the first document whose _id comes after the given one,
+            // whether or not it has been dropped. gets its DOM position and 
+            // slot, or the DOM size and the next slot if there isn't one.
+            void positionAfterId(const char* id, uint32_t& domIdx, uint32_t& slot) const;
+
+            // the entries of an ordered index on a single field, or nullptr
+            const IndexSet* orderedIndex(const std::string& field_name) const;
+
+            // true if an index on the field has entries for array elements
+            bool multikeyIndex(const std::string& field_name) const;
+
+            // updates and drops leave the replaced memory in the collection's
+            // pool. compact() copies the live documents into a fresh pool
+            // and releases the old one. returns the number of bytes released.
+            size_t compact();
+            size_t memoryUsage() const;
+
         private:
+            friend class QueryPlanner;
+
             class Index {
                 public:
+                    // a field name with commas such as "tenant,status" 
+                    // creates a compound index over those fields
+                    Index(const char* field_name, IndexKind kind);
+
+                    // gets the indexed values of a document, sorted and without 
+                    // duplicates. an array gives a value for each string or 
+                    // number in it. returns false if there aren't any.
+                    bool keys(const ValueType& doc, std::vector<Value>& vals) const;
+                    bool matches(const ValueType& doc, const Value& val) const;
+
+                    // compound keys need an indexable value in the first field.
+                    // the other fields may be missing.
+                    bool compoundKey(const ValueType& doc, std::vector<Value>& key) const;
+
+                    void add(const ValueType& doc, uint32_t slot);
+                    void remove(const ValueType& doc, uint32_t slot);
+                    void clear();
+
+                    // indexes a document that had the before keys. only 
+                    // entries for values that have changed are moved.
+                    void reindex(const std::vector<Value>& before, 
+                            const ValueType& doc, uint32_t slot);
+                    void rekey(const std::vector<Value>& before, 
+                            const std::vector<Value>& after, uint32_t slot);
+
+                    static bool hashValue(const Value& val, uint32_t& hash);
+
                     std::string field_name;
                     PointerType field;
-                    std::multimap<Spino::Value, uint32_t> index;
+                    IndexKind kind;
+                    IndexSet index;
+                    HashIndex hash;
+
+                    // the number of distinct keys. used by the query planner 
+                    // to estimate how many documents a lookup will find.
+                    uint32_t distinct = 0;
+
+                    // set once a document has an array in an indexed field.
+                    // a multikey index can have more than one entry for a
+                    // document, so ranges of it need to be de-duplicated 
+                    // and its keys aren't the values of the field.
+                    bool multikey = false;
+
+                    bool compound = false;
+                    std::vector<std::string> field_names;
+                    std::vector<PointerType> fields;
+                    CompoundSet compound_index;
             };
 
+            // if the query is a range comparison or a $startsWith on a field
+            // with an ordered index, gets the range of index entries that 
+            // match it
+            bool indexRange(std::shared_ptr<QueryNode> node, IndexIteratorRange& range) const;
+            void orderedRange(const Index& idx, int op, const Value& v, 
+                    IndexIteratorRange& range) const;
+
+            // finds the slots of the documents that match the value
+            // in a hash index, in ascending order
+            void hashLookup(const Index& idx, const Value& val, 
+                    std::vector<uint32_t>& matched) const;
+
 
+            void insertNewDoc(ValueType& d);
             void indexNewDoc();
             void removeDomIdxFromIndex(uint32_t domIdx);
+            void assignSlots();
+            void markTombstone(uint32_t domIdx);
+            uint32_t physicalIndex(uint32_t logicalIdx) const;
+            uint32_t logicalSize() const;
             bool domIndexFromId(const char* s, uint32_t& domIdx) const;
             void reconstructIndices();
 
             std::vector<Index*> indices;
             bool mergeObjects(ValueType& dstObject, ValueType& srcObject);
 
-            uint32_t fnv1a_hash(std::string& s);
+            // merges an update into a document and moves any index entries
+            // whose values were changed by it
+            void mergeAndReindex(uint32_t domIdx, ValueType& update);
+
+            BaseCursor* find(std::shared_ptr<const ParsedQuery> query) const;
+            void updateMatching(const ParsedQuery& query, DocType& j, const char* update);
+            uint32_t dropMatching(const ParsedQuery& query, uint32_t limit);
+            void journalUpdateById(const char* id, DocType& j);
+
             static uint64_t fast_atoi_len(const char * str, uint32_t len)
             {
                 uint64_t val = 0;
@@ -90,12 +278,37 @@ namespace Spino
 
             uint32_t id_counter;
             std::string name;
-            DocType& doc;
+            AllocatorType allocator;
+            ValueType dom; // the array of documents. allocated from the pool
+
+            // every document is given a slot number when it is added. 
+            // slot numbers only ever increase so this list is sorted and
+            // a document's position can be found with a binary search. 
+            // indices refer to documents by slot so that dropping a document
+            // doesn't move any index entries.
+            std::vector<uint32_t> slots;
+            uint32_t next_slot = 0;
+
+            // the top bit of a slot number marks a dropped document
+            static const uint32_t TOMBSTONE = 0x80000000;
+            uint32_t tombstones = 0;
+            uint32_t first_tombstone = UINT32_MAX;
+
+            // while the compactor is part way through the collection, the 
+            // documents between compact_write and compact_read have been 
+            // moved out and the binary searches step over them.
+            bool compacting = false;
+            uint32_t compact_write = 0;
+            uint32_t compact_read = 0;
+            uint32_t compaction_budget = UINT32_MAX;
             JournalWriter& jw;
-            std::map<uint32_t, std::string> hashmap;
+            QueryCache& query_cache;
+            ThreadPool& pool;
 
-            const uint32_t FNV_PRIME = 16777619u;
-            const uint32_t OFFSET_BASIS = 2166136261u;
+            // counts writes to the collection, so cached results can tell
+            // if they're still valid
+            uint64_t generation = 0;
+            mutable ResultCache result_cache;
             uint64_t last_append_timestamp = 0;
     };
 
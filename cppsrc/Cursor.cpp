@@ -20,13 +20,82 @@
 
 
 #include "Cursor.h"
+#include "Collection.h"
 #include "SpinoSquirrel.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
 using namespace std;
 
 
 namespace Spino {
+    // sub object field names are separated by dots, such as "a.b"
+    static PointerType fieldPointer(const std::string& field_name) {
+        std::string ptr;
+        stringstream ss(field_name);
+        string part;
+        while(getline(ss, part, '.')) {
+            ptr += "/" + part;
+        }
+        return PointerType(ptr.c_str());
+    }
+
+    // gets the value of a resume token key as it would be in an index
+    static bool indexKey(const ValueType* v, Value& val) {
+        if(v && v->IsString()) {
+            val.type = TYPE_STRING;
+            val.str = v->GetString();
+            return true;
+        }
+        if(v && v->IsNumber()) {
+            val.type = TYPE_NUMERIC;
+            val.numeric = v->GetDouble();
+            return true;
+        }
+        return false;
+    }
+
+    // keeps an iterator found by a search of the whole index inside a range
+    static IndexSet::const_iterator clampToRange(const IndexSet& index, 
+            const IndexIteratorRange& range, IndexSet::const_iterator it) {
+        if(range.first == range.second) {
+            return range.first;
+        }
+        if((it != index.end()) && (*it < *range.first)) {
+            return range.first;
+        }
+        if((range.second != index.end()) && ((it == index.end()) || !(*it < *range.second))) {
+            return range.second;
+        }
+        return it;
+    }
+
+    // gets the fields a projection reads, with sub objects joined by dots.
+    // returns false if they can't be named that way.
+    static bool projectionFields(const ValueType& proj, const std::string& prefix, 
+            std::vector<std::string>& fields) {
+        if(!proj.IsObject() || (proj.MemberCount() == 0)) {
+            return false;
+        }
+        for(auto itr = proj.MemberBegin(); itr != proj.MemberEnd(); ++itr) {
+            std::string name(itr->name.GetString(), itr->name.GetStringLength());
+            if(name.empty() || (name.find('.') != std::string::npos)) {
+                return false;
+            }
+            if(itr->value.IsObject()) {
+                if(!projectionFields(itr->value, prefix + name + ".", fields)) {
+                    return false;
+                }
+            }
+            else {
+                fields.push_back(prefix + name);
+            }
+        }
+        return true;
+    }
+
     BaseCursor::BaseCursor() {
         max_results = UINT32_MAX;
         projection_set = false;
@@ -43,6 +112,430 @@ namespace Spino {
         return this;
     }
 
+    BaseCursor* BaseCursor::setSkip(uint32_t n) {
+        skip = n;
+        return this;
+    }
+
+    BaseCursor* BaseCursor::setSort(const char* s) {
+        // field names may be quoted or bare, like in queries
+        std::vector<SortKey> keys;
+        const char* p = s;
+        auto skip = [&]() { 
+            while(isspace((unsigned char)*p)) {
+                p++; 
+            }
+        };
+
+        skip();
+        if(*p++ != '{') {
+            cout << "SpinoDB:: sort parse error: expected {" << endl;
+            return this;
+        }
+        while(true) {
+            skip();
+            if(*p == '}') {
+                break;
+            }
+
+            SortKey key;
+            if(*p == '"') {
+                const char* end = strchr(++p, '"');
+                if(end == nullptr) {
+                    cout << "SpinoDB:: sort parse error: missing \"" << endl;
+                    return this;
+                }
+                key.field_name.assign(p, end);
+                p = end + 1;
+            }
+            else {
+                while(isalnum((unsigned char)*p) || (*p == '_') || (*p == '.') || (*p == '$')) {
+                    key.field_name += *p++;
+                }
+            }
+            skip();
+            if(key.field_name.empty() || (*p++ != ':')) {
+                cout << "SpinoDB:: sort parse error: expected a field name and :" << endl;
+                return this;
+            }
+
+            char* end;
+            long direction = strtol(p, &end, 10);
+            if((end == p) || (direction == 0)) {
+                cout << "SpinoDB:: sort parse error: expected 1 or -1" << endl;
+                return this;
+            }
+            p = end;
+            key.direction = (direction < 0) ? -1 : 1;
+
+            key.field = fieldPointer(key.field_name);
+            keys.push_back(key);
+
+            skip();
+            if(*p == ',') {
+                p++;
+            }
+            else if(*p != '}') {
+                cout << "SpinoDB:: sort parse error: expected , or }" << endl;
+                return this;
+            }
+        }
+
+        sort_keys = keys;
+        return this;
+    }
+
+    // strings, numbers, booleans, arrays, objects, null, then missing
+    static int typeRank(const ValueType* v) {
+        if(v == nullptr) {
+            return 6;
+        }
+        switch(v->GetType()) {
+            case rapidjson::kStringType: return 0;
+            case rapidjson::kNumberType: return 1;
+            case rapidjson::kFalseType: 
+            case rapidjson::kTrueType: return 2;
+            case rapidjson::kArrayType: return 3;
+            case rapidjson::kObjectType: return 4;
+            default: return 5;
+        }
+    }
+
+    int compareValues(const ValueType* a, const ValueType* b) {
+        int ra = typeRank(a);
+        int rb = typeRank(b);
+        if(ra != rb) {
+            return (ra < rb) ? -1 : 1;
+        }
+        switch(ra) {
+            case 0:
+                {
+                    size_t la = a->GetStringLength();
+                    size_t lb = b->GetStringLength();
+                    int cmp = memcmp(a->GetString(), b->GetString(), std::min(la, lb));
+                    if(cmp != 0) {
+                        return cmp;
+                    }
+                    return (la < lb) ? -1 : ((la > lb) ? 1 : 0);
+                }
+            case 1:
+                {
+                    double da = a->GetDouble();
+                    double db = b->GetDouble();
+                    return (da < db) ? -1 : ((da > db) ? 1 : 0);
+                }
+            case 2:
+                return (int)a->GetBool() - (int)b->GetBool();
+        }
+        return 0;
+    }
+
+    int BaseCursor::compareDocuments(const ValueType& a, const ValueType& b) const {
+        for(auto& key : sort_keys) {
+            int cmp = compareValues(key.field.Get(a), key.field.Get(b));
+            if(cmp != 0) {
+                return cmp * key.direction;
+            }
+        }
+        return 0;
+    }
+
+    void BaseCursor::sortDocuments(std::vector<const ValueType*>& docs) const {
+        std::stable_sort(docs.begin(), docs.end(), 
+                [this](const ValueType* a, const ValueType* b) {
+                    return compareDocuments(*a, *b) < 0;
+                });
+    }
+
+    void BaseCursor::sortResults() {
+        sorted = true;
+
+        // entries remember the order they were found in so that equal 
+        // documents stay in that order
+        struct Entry {
+            const ValueType* doc;
+            uint32_t seq;
+        };
+        auto less = [this](const Entry& a, const Entry& b) {
+            int cmp = compareDocuments(*a.doc, *b.doc);
+            return (cmp != 0) ? (cmp < 0) : (a.seq < b.seq);
+        };
+
+        // skipped results have to be sorted too
+        uint32_t keep = max_results;
+        if(keep != UINT32_MAX) {
+            keep = (uint32_t)std::min<uint64_t>((uint64_t)keep + skip, UINT32_MAX - 1);
+        }
+
+        std::vector<Entry> entries;
+        uint32_t seq = 0;
+        const ValueType* d;
+        if(keep == UINT32_MAX) {
+            while((d = fetch())) {
+                entries.push_back({d, seq++});
+            }
+            std::sort(entries.begin(), entries.end(), less);
+        }
+        else if(keep > 0) {
+            // with a limit, only the best documents are kept in a max heap.
+            // the worst of them is at the top, ready to be replaced.
+            while((d = fetch())) {
+                Entry e = {d, seq++};
+                if(entries.size() < keep) {
+                    entries.push_back(e);
+                    std::push_heap(entries.begin(), entries.end(), less);
+                }
+                else if(less(e, entries.front())) {
+                    std::pop_heap(entries.begin(), entries.end(), less);
+                    entries.back() = e;
+                    std::push_heap(entries.begin(), entries.end(), less);
+                }
+            }
+            std::sort_heap(entries.begin(), entries.end(), less);
+        }
+
+        results.reserve(entries.size());
+        for(auto& e : entries) {
+            results.push_back(e.doc);
+        }
+    }
+
+    BaseCursor* BaseCursor::resumeAfter(const char* token) {
+        resume.Parse(token);
+        resume_set = false;
+
+        // a token that can't be used gives no results rather than
+        // starting again from the first page
+        const char* error = nullptr;
+        if(resume.HasParseError() || !resume.IsObject()) {
+            error = "could not parse the token";
+        }
+        else if(resume.HasMember("skip")) {
+            if(!resume["skip"].IsUint()) {
+                error = "skip must be a number";
+            }
+        }
+        else if(!resume.HasMember("after") || !resume["after"].IsString() || 
+                (resume["after"].GetStringLength() != 16)) {
+            error = "expected an _id";
+        }
+
+        if(error) {
+            cout << "SpinoDB:: resume token error: " << error << endl;
+            exhausted = true;
+        }
+        else {
+            resume_set = true;
+        }
+        return this;
+    }
+
+    std::string BaseCursor::resumeToken() {
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        if(last == nullptr) {
+            if(!resume_set) {
+                return "";
+            }
+            resume.Accept(writer);
+            return buffer.GetString();
+        }
+
+        writer.StartObject();
+        bool sorting = sort_keys.size() && !ordered_by_cursor;
+        auto doc = source(last);
+        bool has_id = false;
+        if(doc && doc->IsObject()) {
+            auto id = doc->FindMember("_id");
+            has_id = (id != doc->MemberEnd()) && id->value.IsString() && 
+                (id->value.GetStringLength() == 16);
+        }
+        if(!sorting && has_id) {
+            auto key = tokenKey(*doc);
+            if(key) {
+                writer.Key("key");
+                key->Accept(writer);
+            }
+            writer.Key("after");
+            writer.String((*doc)["_id"].GetString());
+        }
+        else {
+            writer.Key("skip");
+            writer.Uint(position);
+        }
+        writer.EndObject();
+        return buffer.GetString();
+    }
+
+    void BaseCursor::start() {
+        started = true;
+        if((sort_keys.size() == 1) && orderBy(sort_keys[0])) {
+            ordered_by_cursor = true;
+        }
+
+        // covered results are overwritten as the cursor moves, so they 
+        // can't be gathered up and sorted here
+        std::vector<std::string> fields;
+        bool sorting = sort_keys.size() && !ordered_by_cursor;
+        if(projection_set && !sorting && projectionFields(projection, "", fields)) {
+            cover(fields);
+        }
+
+        if(resume_set) {
+            if(resume.HasMember("skip")) {
+                uint32_t n = resume["skip"].GetUint();
+                skip = (uint32_t)std::min<uint64_t>((uint64_t)skip + n, UINT32_MAX);
+            }
+            else {
+                // results that were sorted here can only be skipped to
+                const ValueType* key = resume.HasMember("key") ? &resume["key"] : nullptr;
+                bool sorting = sort_keys.size() && !ordered_by_cursor;
+                if(sorting || !seek(key, resume["after"].GetString())) {
+                    cout << "SpinoDB:: resume token error: the token is for a different query" << endl;
+                    exhausted = true;
+                }
+            }
+        }
+
+        for(uint32_t i = 0; (i < skip) && !exhausted; i++) {
+            const ValueType* d = nextResult();
+            if(d == nullptr) {
+                break;
+            }
+            last = d;
+            position++;
+        }
+    }
+
+    const ValueType* BaseCursor::nextResult() {
+        if(sort_keys.size() && !ordered_by_cursor) {
+            if(!sorted) {
+                sortResults();
+            }
+            if(result_pos < results.size()) {
+                return results[result_pos++];
+            }
+            return nullptr;
+        }
+        return fetch();
+    }
+
+    const ValueType* BaseCursor::pull() {
+        auto begin = std::chrono::steady_clock::now();
+        if(!started) {
+            start();
+        }
+
+        const ValueType* d = nullptr;
+        if(!exhausted && (counter < max_results)) {
+            d = nextResult();
+            if(d) {
+                counter++;
+            }
+        }
+
+        std::chrono::duration<double, std::micro> t = std::chrono::steady_clock::now() - begin;
+        exec_micros += t.count();
+        return d;
+    }
+
+    void BaseCursor::consume() {
+        primed = false;
+        last = pending;
+        position++;
+    }
+
+    bool BaseCursor::hasNext() {
+        if(!primed) {
+            pending = pull();
+            primed = true;
+        }
+        return pending != nullptr;
+    }
+
+    void BaseCursor::setPlan(const char* p, const std::vector<std::string>& indices, 
+            double plan_micros) {
+        plan = p;
+        plan_indices = indices;
+        exec_micros += plan_micros;
+    }
+
+    void BaseCursor::setParseTime(double micros, bool cached) {
+        parse_micros = micros;
+        query_cached = cached;
+    }
+
+    std::string BaseCursor::explain() {
+        while(hasNext()) {
+            consume();
+        }
+
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        writer.SetMaxDecimalPlaces(3);
+        writer.StartObject();
+        writer.Key("plan");
+        writer.String(plan.c_str());
+        writer.Key("indices");
+        writer.StartArray();
+        for(auto& name : plan_indices) {
+            writer.String(name.c_str());
+        }
+        writer.EndArray();
+        writer.Key("covered");
+        writer.Bool(covered);
+        writer.Key("sort");
+        if(sort_keys.empty()) {
+            writer.String("none");
+        }
+        else {
+            writer.String(ordered_by_cursor ? "index" : "sorted");
+        }
+        writer.Key("keysExamined");
+        writer.Uint64(keys_examined);
+        writer.Key("docsExamined");
+        writer.Uint64(docs_examined);
+        writer.Key("returned");
+        writer.Uint(counter);
+        writer.Key("queryCached");
+        writer.Bool(query_cached);
+        writer.Key("parseMicros");
+        writer.Double(parse_micros);
+        writer.Key("executionMicros");
+        writer.Double(exec_micros);
+        writer.EndObject();
+        return buffer.GetString();
+    }
+
+    std::string BaseCursor::next() {
+        if(!hasNext()) {
+            return "";
+        }
+        consume();
+
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        if(projection_set) {
+            apply_projection(projection, *pending, writer);
+        }
+        else {
+            pending->Accept(writer);
+        }
+        return buffer.GetString();
+    }
+
+    const ValueType& BaseCursor::nextAsJsonObj() {
+        static const ValueType null_value;
+        if(!hasNext()) {
+            return null_value;
+        }
+        consume();
+
+        // the whole document, even if the cursor is covered
+        auto doc = source(pending);
+        return doc ? *doc : null_value;
+    }
+
 
     void BaseCursor::apply_projection(
             const ValueType& proj, 
@@ -122,148 +615,565 @@ namespace Spino {
         return ret;
     }
 
-    LinearCursor::LinearCursor(ValueType& list, const char* query) : list(list) { 
-        Spino::QueryParser parser(query);
-        try {
-            head = parser.parse_expression();
+    size_t rangeSize(const IndexSet& index, const IndexIteratorRange& range) {
+#ifdef SPINO_COUNTED_INDEX
+        auto rank = [&](IndexSet::const_iterator it) {
+            return (it == index.end()) ? index.size() : index.order_of_key(*it);
+        };
+        return rank(range.second) - rank(range.first);
+#else
+        return std::distance(range.first, range.second);
+#endif
+    }
+
+    bool KeyDocument::init(const std::vector<std::string>& field_names) {
+        for(auto& a : field_names) {
+            for(auto& b : field_names) {
+                if((a.size() > b.size()) && (a.compare(0, b.size() + 1, b + ".") == 0)) {
+                    return false;
+                }
+            }
+        }
+
+        // the leaves are found after every field has been created, as
+        // adding a member can move the others
+        for(int i = 0; i < 2; i++) {
+            docs[i].SetObject();
+            for(auto& name : field_names) {
+                fieldPointer(name).Create(docs[i]);
+            }
+            leaves[i].clear();
+            for(auto& name : field_names) {
+                leaves[i].push_back(fieldPointer(name).Get(docs[i]));
+            }
+        }
+        return true;
+    }
+
+    const ValueType* KeyDocument::set(const Value* keys, uint32_t slot) {
+        current ^= 1;
+        auto& leaf = leaves[current];
+        for(size_t i = 0; i < leaf.size(); i++) {
+            const Value& key = keys[i];
+            if(key.type == TYPE_STRING) {
+                leaf[i]->SetString(rapidjson::StringRef(key.str.data(), key.str.size()));
+            }
+            else if(key.type == TYPE_NUMERIC) {
+                // whole numbers are written as integers
+                double d = key.numeric;
+                if((fabs(d) < 9007199254740992.0) && (d == (double)(int64_t)d)) {
+                    leaf[i]->SetInt64((int64_t)d);
+                }
+                else {
+                    leaf[i]->SetDouble(d);
+                }
+            }
+            else {
+                return nullptr;
+            }
+        }
+        slots[current] = slot;
+        return &docs[current];
+    }
+
+    bool KeyDocument::slotOf(const ValueType* result, uint32_t& slot) const {
+        for(int i = 0; i < 2; i++) {
+            if(result == &docs[i]) {
+                slot = slots[i];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // gets the document of a result that might be a key document
+    static const ValueType* keySource(const Collection& collection, 
+            const KeyDocument& keys, const ValueType* result) {
+        uint32_t slot, domIdx;
+        if(!keys.slotOf(result, slot)) {
+            return result;
+        }
+        if(!collection.domIndexFromSlot(slot, domIdx)) {
+            return nullptr;
         }
-        catch(parse_error& e) {
-            cout << "SpinoDB:: parse error: " << e.what() << endl;
-            counter = max_results;
+        return &collection.getDom()[domIdx];
+    }
+
+    void DescendingWalk::reset(IndexIteratorRange r) {
+        range = r;
+        pos = run = run_end = range.second;
+    }
+
+    bool DescendingWalk::next(IndexSet::const_iterator& entry) {
+        if(run == run_end) {
+            if(pos == range.first) {
+                return false;
+            }
+            // find the start of the run of entries with the last value
+            run_end = pos;
+            auto it = std::prev(pos);
+            while((it != range.first) && !(std::prev(it)->first < it->first)) {
+                it--;
+            }
+            run = pos = it;
         }
-        iter = list.Begin();
-        findNext();
+        entry = run++;
+        return true;
+    }
+
+    void DescendingWalk::seek(const IndexSet& index, const Value& key, uint32_t slot) {
+        // the rest of the run with the key, then the values below it
+        pos = clampToRange(index, range, index.lower_bound({key, 0}));
+        run = clampToRange(index, range, index.lower_bound({key, slot}));
+        run_end = clampToRange(index, range, index.lower_bound({key, UINT32_MAX}));
+    }
+
+
+    LinearCursor::LinearCursor(const Collection& collection, std::shared_ptr<const ParsedQuery> query) : 
+        collection(collection),
+        list(collection.getDom()),
+        query(query) { 
+        parallel = collection.scanThreads() > 1;
+        block = Collection::SCAN_BLOCK;
     }
 
     LinearCursor::~LinearCursor() { }
 
-    bool LinearCursor::hasNext() {
-        return has_next;
+    uint32_t LinearCursor::count() {
+        if(total < 0) {
+            total = (scanned && from_start) ? found : collection.scanCount(query->program);
+        }
+        return total;
+    }
+
+    void LinearCursor::recordMatches(const std::string& key, uint64_t generation) {
+        recording = true;
+        record_key = key;
+        record_generation = generation;
+    }
+
+    const ValueType* LinearCursor::result(uint32_t domIdx) {
+        found++;
+        if(recording) {
+            recorded.push_back(collection.slotAt(domIdx));
+        }
+        return &list[domIdx];
+    }
+
+    void LinearCursor::finish() {
+        scanned = true;
+        if(recording && from_start) {
+            collection.cacheMatches(record_key, record_generation, std::move(recorded));
+        }
+        recording = false;
     }
 
-    std::string LinearCursor::next() {
-        if(has_next) {
-            rapidjson::StringBuffer buffer;
-            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-            if(projection_set) {
-                apply_projection(projection, *iter, writer);
+    const ValueType* LinearCursor::fetch() {
+        if(sort_index) {
+            return fetchByIndex();
+        }
+
+        if(parallel) {
+            while(matched_pos == matched.size()) {
+                if(pos >= list.Size()) {
+                    finish();
+                    return nullptr;
+                }
+                uint32_t end = std::min(list.Size(), pos + block);
+                matched.clear();
+                matched_pos = 0;
+                collection.scan(query->program, pos, end, matched);
+                docs_examined += end - pos;
+                pos = end;
+                block = std::min(block * 2, Collection::SCAN_BLOCK_MAX);
             }
-            else {
-                iter->Accept(writer);
+            return result(matched[matched_pos++]);
+        }
+
+        while(pos < list.Size()) {
+            // skip documents that have been dropped but not compacted
+            uint32_t i = pos++;
+            if(!collection.isLive(i)) {
+                continue;
             }
-            std::string ret = buffer.GetString();
+            docs_examined++;
+            if(query->program.matches(list[i])) {
+                return result(i);
+            }
+        }
+        finish();
+        return nullptr;
+    }
 
-            iter++;
-            findNext();
-            return ret;
+    bool LinearCursor::orderBy(const SortKey& key) {
+        // a multikey index has entries for elements, not for the arrays
+        if(collection.multikeyIndex(key.field_name)) {
+            return false;
         }
-        return "";
+        sort_index = collection.orderedIndex(key.field_name);
+        if(sort_index == nullptr) {
+            return false;
+        }
+        sort_field = key.field;
+        sort_direction = key.direction;
+        index_pos = sort_index->begin();
+        walk.reset({sort_index->begin(), sort_index->end()});
+        return true;
+    }
 
+    const ValueType* LinearCursor::tokenKey(const ValueType& doc) {
+        // documents without the sort field have no key
+        if(sort_index) {
+            return sort_field.Get(doc);
+        }
+        return nullptr;
     }
 
-    uint32_t LinearCursor::count() {
-        uint32_t r = 0;
-        auto itr = list.Begin();
-        while(itr != list.End()) {
-            exec.set_json(&(*itr));
-            if(exec.resolve(head)) {
-                r++;
+    bool LinearCursor::seek(const ValueType* key, const char* after_id) {
+        uint32_t domIdx, slot;
+        collection.positionAfterId(after_id, domIdx, slot);
+        if(sort_index == nullptr) {
+            if(key) {
+                return false;
             }
-            itr++;
+            pos = domIdx;
+            from_start = false;
+            return true;
         }
 
-        return r;
+        Value val;
+        if(indexKey(key, val)) {
+            if(sort_direction > 0) {
+                phase = 0;
+                index_pos = sort_index->lower_bound({val, slot});
+            }
+            else {
+                phase = 1;
+                walk.seek(*sort_index, val, slot);
+            }
+            return true;
+        }
+
+        // the unindexed documents are sorted by the key and then by 
+        // position, so the next one is found with a binary search
+        phase = (sort_direction > 0) ? 1 : 0;
+        findUnindexed();
+        auto it = std::partition_point(unindexed.begin(), unindexed.end(), 
+                [&](const ValueType* d) {
+                    int cmp = compareValues(sort_field.Get(*d), key) * sort_direction;
+                    return (cmp < 0) || ((cmp == 0) && ((uint32_t)(d - &list[0]) < domIdx));
+                });
+        unindexed_pos = it - unindexed.begin();
+        return true;
     }
 
-    void LinearCursor::findNext() {
-        has_next = false;
-        if(counter < max_results) {
-            while(iter != list.End()) {
-                exec.set_json(&(*iter));	
-                if(exec.resolve(head)) {
-                    has_next = true;
-                    counter++;
-                    return;
-                }
-                else {
-                    iter++;
+    void LinearCursor::findUnindexed() {
+        // only strings and numbers are indexed. everything else sorts 
+        // after them, so those documents are found with a scan.
+        unindexed_ready = true;
+        uint32_t n = list.Size();
+        for(uint32_t i = 0; i < n; i++) {
+            if(!collection.isLive(i)) {
+                continue;
+            }
+            docs_examined++;
+            auto v = sort_field.Get(list[i]);
+            if((v == nullptr) || !(v->IsString() || v->IsNumber())) {
+                if(query->program.matches(list[i])) {
+                    unindexed.push_back(&list[i]);
                 }
-            }               
+            }
         }
+        sortDocuments(unindexed);
     }
 
+    const ValueType* LinearCursor::fetchByIndex() {
+        // ascending is the index then the rest. descending is the reverse.
+        bool index_phase = (sort_direction > 0) ? (phase == 0) : (phase == 1);
+        if(index_phase) {
+            IndexSet::const_iterator entry;
+            while(true) {
+                if(sort_direction > 0) {
+                    if(index_pos == sort_index->end()) {
+                        break;
+                    }
+                    entry = index_pos++;
+                }
+                else if(!walk.next(entry)) {
+                    break;
+                }
+
+                keys_examined++;
+                uint32_t domIdx;
+                if(!collection.domIndexFromSlot(entry->second, domIdx)) {
+                    continue;
+                }
+                docs_examined++;
+                if(query->program.matches(list[domIdx])) {
+                    return &list[domIdx];
+                }
+            }
+        }
+        else {
+            if(!unindexed_ready) {
+                findUnindexed();
+            }
+            if(unindexed_pos < unindexed.size()) {
+                return unindexed[unindexed_pos++];
+            }
+        }
 
-    const ValueType& LinearCursor::nextAsJsonObj() { 
-        if(has_next) {
-            const ValueType& ret = *iter;
-            iter++;
-            findNext();
-            return ret;
+        if(phase == 0) {
+            phase = 1;
+            return fetchByIndex();
         }
-        return ValueType();
+        return nullptr;
     }
 
 
-    EqIndexCursor::EqIndexCursor(IndexIteratorRange iter_range, ValueType& collection_dom) : 
-        collection_dom(collection_dom),
-        iter_range(iter_range)
+    RangeIndexCursor::RangeIndexCursor(IndexIteratorRange iter_range, const Collection& collection,
+            const std::string& field_name) : 
+        collection(collection),
+        iter_range(iter_range),
+        field_name(field_name)
     {
         iter = iter_range.first;
+        field = fieldPointer(field_name);
     }
 
-    EqIndexCursor::~EqIndexCursor() { }
+    RangeIndexCursor::~RangeIndexCursor() { }
 
-    bool EqIndexCursor::hasNext() {
-        if((counter < max_results) && (iter != iter_range.second)) {
-            return true;
+    uint32_t RangeIndexCursor::count() {
+        return rangeSize(*collection.orderedIndex(field_name), iter_range);
+    }
+
+    bool RangeIndexCursor::orderBy(const SortKey& key) {
+        // the range is already in ascending order, unless the field 
+        // holds arrays
+        if((key.field_name != field_name) || collection.multikeyIndex(field_name)) {
+            return false;
         }
-        else {
+        if(key.direction < 0) {
+            descending = true;
+            walk.reset(iter_range);
+        }
+        return true;
+    }
+
+    const ValueType* RangeIndexCursor::tokenKey(const ValueType& doc) {
+        return field.Get(doc);
+    }
+
+    bool RangeIndexCursor::cover(const std::vector<std::string>& fields) {
+        if(collection.multikeyIndex(field_name)) {
             return false;
         }
+        for(auto& f : fields) {
+            if(f != field_name) {
+                return false;
+            }
+        }
+        covered = keys.init({field_name});
+        return covered;
+    }
+
+    const ValueType* RangeIndexCursor::source(const ValueType* result) {
+        return covered ? keySource(collection, keys, result) : result;
+    }
+
+    bool RangeIndexCursor::seek(const ValueType* key, const char* after_id) {
+        auto index = collection.orderedIndex(field_name);
+        Value val;
+        if((index == nullptr) || !indexKey(key, val)) {
+            return false;
+        }
+
+        uint32_t domIdx, slot;
+        collection.positionAfterId(after_id, domIdx, slot);
+        if(descending) {
+            walk.seek(*index, val, slot);
+        }
+        else {
+            iter = clampToRange(*index, iter_range, index->lower_bound({val, slot}));
+        }
+        return true;
     }
 
-    std::string EqIndexCursor::next() {
-        if(counter < max_results) {
-            if(iter != iter_range.second) {
-                rapidjson::StringBuffer buffer;
-                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-                if(projection_set) {
-                    apply_projection(projection, 
-                            collection_dom[iter->second], writer);
+    const ValueType* RangeIndexCursor::fetch() {
+        while(true) {
+            IndexSet::const_iterator entry;
+            if(descending) {
+                if(!walk.next(entry)) {
+                    return nullptr;
                 }
-                else {
-                    collection_dom[iter->second].Accept(writer);
+            }
+            else {
+                if(iter == iter_range.second) {
+                    return nullptr;
                 }
-                iter++;
-                counter++;
-                return buffer.GetString();
-            } 
+                entry = iter++;
+            }
+
+            // dropping a document removes its index entries, so the 
+            // keys of a covered cursor always belong to a live document
+            keys_examined++;
+            if(covered) {
+                return keys.set(&entry->first, entry->second);
+            }
+
+            uint32_t domIdx;
+            if(collection.domIndexFromSlot(entry->second, domIdx)) {
+                docs_examined++;
+                return &collection.getDom()[domIdx];
+            }
         }
-        return "";
     }
 
-    uint32_t EqIndexCursor::count() {
-        uint32_t r = 0;
-        auto itr = iter_range.first;
-        while(itr != iter_range.second) {
-            itr++;
-            r++;
-        }	
-        return r;
+
+    SlotCursor::SlotCursor(std::vector<uint32_t>&& slots, const Collection& collection,
+            std::shared_ptr<const ParsedQuery> filter) : 
+        collection(collection),
+        slots(std::move(slots)),
+        filter(filter)
+    {
     }
 
-    const ValueType& EqIndexCursor::nextAsJsonObj() {
-        if(counter < max_results) {
-            if(iter != iter_range.second) {
-                const ValueType& ret = collection_dom[iter->second];
-                iter++;
-                counter++;
-                return ret;
-            } 
+    SlotCursor::~SlotCursor() { }
+
+    bool SlotCursor::matches(uint32_t slot, uint32_t& domIdx) {
+        if(!collection.domIndexFromSlot(slot, domIdx)) {
+            return false;
         }
-        return ValueType();
+        docs_examined++;
+        if(filter) {
+            return filter->program.matches(collection.getDom()[domIdx]);
+        }
+        return true;
     }
 
+    void SlotCursor::setKeyRange(CompoundIteratorRange range, 
+            const std::vector<std::string>& field_names) {
+        std::vector<PointerType> fields;
+        for(auto& name : field_names) {
+            fields.push_back(fieldPointer(name));
+        }
+        key_range = range;
+        key_names = field_names;
+        keyed = ((filter == nullptr) || filter->program.readsOnly(fields)) && 
+            keys.init(field_names);
+    }
+
+    void SlotCursor::loadEntries() {
+        if(entries.size() || slots.empty()) {
+            return;
+        }
+        for(auto iter = key_range.first; iter != key_range.second; iter++) {
+            entries.push_back(&*iter);
+        }
+        std::sort(entries.begin(), entries.end(), 
+                [](const CompoundEntry* a, const CompoundEntry* b) {
+                    return a->second < b->second;
+                });
+
+        // the candidates may have been narrowed down further by other
+        // indices, but every result is in the range
+        slots.resize(entries.size());
+        for(size_t i = 0; i < entries.size(); i++) {
+            slots[i] = entries[i]->second;
+        }
+    }
+
+    const ValueType* SlotCursor::keyResult(const CompoundEntry& entry, KeyDocument& key_doc) {
+        auto d = key_doc.set(entry.first.data(), entry.second);
+        if(d == nullptr) {
+            // the document has a field that the index couldn't hold
+            uint32_t domIdx;
+            return matches(entry.second, domIdx) ? &collection.getDom()[domIdx] : nullptr;
+        }
+        if(filter && !filter->program.matches(*d)) {
+            return nullptr;
+        }
+        return d;
+    }
+
+    bool SlotCursor::cover(const std::vector<std::string>& fields) {
+        if(!keyed) {
+            return false;
+        }
+        for(auto& f : fields) {
+            if(std::find(key_names.begin(), key_names.end(), f) == key_names.end()) {
+                return false;
+            }
+        }
+        loadEntries();
+        covered = true;
+        return true;
+    }
+
+    const ValueType* SlotCursor::source(const ValueType* result) {
+        return covered ? keySource(collection, keys, result) : result;
+    }
+
+    const ValueType* SlotCursor::fetch() {
+        if(covered) {
+            while(pos < entries.size()) {
+                keys_examined++;
+                auto d = keyResult(*entries[pos++], keys);
+                if(d) {
+                    return d;
+                }
+            }
+            return nullptr;
+        }
+
+        uint32_t domIdx;
+        while(pos < slots.size()) {
+            keys_examined++;
+            if(matches(slots[pos++], domIdx)) {
+                return &collection.getDom()[domIdx];
+            }
+        }
+        return nullptr;
+    }
+
+    bool SlotCursor::seek(const ValueType* key, const char* after_id) {
+        // the slots are in ascending order, which is the order of the _ids
+        if(key) {
+            return false;
+        }
+        uint32_t domIdx, slot;
+        collection.positionAfterId(after_id, domIdx, slot);
+        pos = std::lower_bound(slots.begin(), slots.end(), slot) - slots.begin();
+        return true;
+    }
+
+    uint32_t SlotCursor::count() {
+        if(filter == nullptr) {
+            return slots.size();
+        }
+
+        uint32_t r = 0;
+        if(keyed) {
+            // a key document of its own leaves the cursor's results alone
+            KeyDocument key_doc;
+            key_doc.init(key_names);
+            loadEntries();
+            for(auto entry : entries) {
+                if(keyResult(*entry, key_doc)) {
+                    r++;
+                }
+            }
+            return r;
+        }
+
+        uint32_t domIdx;
+        for(auto slot : slots) {
+            if(matches(slot, domIdx)) {
+                r++;
+            }
+        }
+        return r;
+    }
 
 }
 
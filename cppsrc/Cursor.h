@@ -27,32 +27,112 @@
 #include <ctime>
 #include <string>
 #include <map>
+#include <set>
 #include <fstream>
 #include <chrono>
 #include <thread>
 #include <sstream>
 
+#ifdef __GLIBCXX__
+#include <ext/pb_ds/assoc_container.hpp>
+#include <ext/pb_ds/tree_policy.hpp>
+#endif
+
 #include "QueryNodes.h"
 #include "QueryParser.h"
+#include "QueryCache.h"
 
 namespace Spino {
+    // compares two values in the order that cursors sort them. 
+    // nullptr is a missing value, which comes last.
+    int compareValues(const ValueType* a, const ValueType* b);
+
     class BaseCursor {
         public:
             BaseCursor();
 
             virtual ~BaseCursor() { };
-            virtual std::string next() = 0;
-            virtual bool hasNext() = 0;
+            std::string next();
+            bool hasNext();
             virtual uint32_t count() = 0;
-            virtual const ValueType& nextAsJsonObj() = 0;
+            const ValueType& nextAsJsonObj();
 
             BaseCursor* setProjection(const char* projection);
             BaseCursor* setLimit(uint32_t max_results);
 
+            // skips the first n results. skipped documents are never 
+            // serialised, and a sorted cursor only keeps skip+limit of them.
+            BaseCursor* setSkip(uint32_t n);
+
+            // orders the results by one or more fields, such as 
+            // "{year: 1, name: -1}". 1 is ascending and -1 is descending.
+            // strings sort before numbers, then booleans, arrays, objects
+            // and nulls. documents without the field come last. documents 
+            // that compare equal keep the order the query found them in.
+            // must be set before the first result is read.
+            BaseCursor* setSort(const char* sort);
+
+            // gets a token for the position after the last result that was
+            // read, or skipped. a cursor for the same query and sort can
+            // continue from there with resumeAfter(). cursors that walk the 
+            // collection or an index in order seek straight to the position 
+            // by _id and index key. results the cursor had to sort itself 
+            // are resumed by skipping. must be resumed before the first 
+            // result is read.
+            std::string resumeToken();
+            BaseCursor* resumeAfter(const char* token);
+
+            // reads the rest of the results without serialising them and 
+            // reports how the query was run as JSON. that is the plan, the
+            // indices it used, the number of index keys and documents that
+            // were examined, the number of results and the microseconds 
+            // spent parsing the query and running it.
+            std::string explain();
+
+            // the collection notes how it chose to run the query
+            void setPlan(const char* plan, const std::vector<std::string>& indices, 
+                    double plan_micros);
+            void setParseTime(double micros, bool cached);
+
             std::string runScript(std::string txt);
 
 
         protected: 
+            struct SortKey {
+                std::string field_name;
+                PointerType field;
+                int direction;
+            };
+
+            // gets the next document that matches the query, or nullptr
+            // if there are no more. the base class applies the sort, 
+            // limit and projection.
+            virtual const ValueType* fetch() = 0;
+
+            // a cursor that can return its results in the order of the 
+            // sort key without sorting them, such as by walking an 
+            // ordered index, sets itself up to do so and returns true
+            virtual bool orderBy(const SortKey& /*key*/) { return false; }
+
+            // resume tokens hold the _id of the last document and, for 
+            // cursors that walk an ordered index, its key. seek() continues
+            // from the document after it and returns true if it can. 
+            // tokenKey() gets the key of a document, or nullptr.
+            virtual bool seek(const ValueType* /*key*/, const char* /*after_id*/) { return false; }
+            virtual const ValueType* tokenKey(const ValueType& /*doc*/) { return nullptr; }
+
+            // a cursor whose query and projection only read indexed fields
+            // can make its results from the index keys without reading the
+            // documents. cover() gets the fields the projection reads and
+            // returns true if the cursor has switched to doing so. 
+            // source() gets the document that a result came from.
+            virtual bool cover(const std::vector<std::string>& /*fields*/) { return false; }
+            virtual const ValueType* source(const ValueType* result) { return result; }
+
+            // compares two documents by the sort keys
+            int compareDocuments(const ValueType& a, const ValueType& b) const;
+            void sortDocuments(std::vector<const ValueType*>& docs) const;
+
             void apply_projection(
                     const ValueType& proj, 
                     const ValueType& source, 
@@ -61,69 +141,272 @@ namespace Spino {
             DocType projection;
             bool projection_set;
             uint32_t max_results;
+            std::vector<SortKey> sort_keys;
+
+            // counted by the cursors for explain()
+            uint64_t keys_examined = 0;
+            uint64_t docs_examined = 0;
+            bool covered = false;
+
+        private:
+            const ValueType* pull();
+            const ValueType* nextResult();
+            void start();
+            void sortResults();
+            void consume();
+
+            // hasNext() fetches the next result ahead of time
+            const ValueType* pending = nullptr;
+            bool primed = false;
+            bool started = false;
+            uint32_t counter = 0;
+
+            // skipping, and the last result that was read or skipped
+            uint32_t skip = 0;
+            uint32_t position = 0;
+            const ValueType* last = nullptr;
+            bool exhausted = false;
+            DocType resume;
+            bool resume_set = false;
+
+            // results that have been sorted by this class
+            bool sorted = false;
+            bool ordered_by_cursor = false;
+            std::vector<const ValueType*> results;
+            size_t result_pos = 0;
+
+            std::string plan = "none";
+            std::vector<std::string> plan_indices;
+            double parse_micros = 0;
+            double exec_micros = 0;
+            bool query_cached = false;
     };
 
     class DudCursor : public BaseCursor {
         public:
             DudCursor() { }
             ~DudCursor() { }
-            std::string next() { return ""; }
-            bool hasNext() { return false; }
             uint32_t count() { return 0; }
             std::string runScript(std::string txt) { return ""; }
 
-            const ValueType& nextAsJsonObj() { return v; }
+        protected:
+            const ValueType* fetch() { return nullptr; }
+    };
+
+
+    class Collection;
+
+    // an index entry is the indexed value and the slot of the document.
+    // entries are sorted by value and then by slot, so an entry can be 
+    // found and removed without walking every document with the same value.
+    typedef std::pair<Spino::Value, uint32_t> IndexEntry;
+
+#ifdef __GLIBCXX__
+    // with libstdc++ the index is a red-black tree that also keeps the 
+    // size of every subtree, so a range is counted without walking it
+    typedef __gnu_pbds::tree<
+        IndexEntry, 
+        __gnu_pbds::null_type, 
+        std::less<IndexEntry>,
+        __gnu_pbds::rb_tree_tag, 
+        __gnu_pbds::tree_order_statistics_node_update
+            > IndexSet;
+#define SPINO_COUNTED_INDEX
+#else
+    typedef std::set<IndexEntry> IndexSet;
+#endif
+
+    // typedef so you can breath while reading this
+    // this is the type name of the pair that holds the start and end iterators 
+    // of a range of values in an index
+    typedef std::pair<
+        IndexSet::const_iterator, 
+        IndexSet::const_iterator
+            > IndexIteratorRange;
+
+    // the number of entries in a range of an index
+    size_t rangeSize(const IndexSet& index, const IndexIteratorRange& range);
+
+    // compound index entries hold the value of each indexed field in order
+    typedef std::pair<std::vector<Value>, uint32_t> CompoundEntry;
+    typedef std::set<CompoundEntry> CompoundSet;
+    typedef std::pair<
+        CompoundSet::const_iterator, 
+        CompoundSet::const_iterator
+            > CompoundIteratorRange;
+
+    // covered cursors make their results from index keys instead of the 
+    // documents. the keys are written into a small document laid out like 
+    // the indexed fields, so projections and filters read it just like the 
+    // real document. strings point into the index and aren't copied. 
+    // there are two of them so the pending result and the last result 
+    // stay valid, and each remembers the slot of its document.
+    class KeyDocument {
+        public:
+            // returns false if one field is inside another
+            bool init(const std::vector<std::string>& field_names);
+
+            // sets the keys of the next result. returns nullptr if a key 
+            // wasn't indexed, and the document has to be read instead.
+            const ValueType* set(const Value* keys, uint32_t slot);
+
+            // gets the slot of a result that set() returned
+            bool slotOf(const ValueType* result, uint32_t& slot) const;
+
         private:
-            ValueType v;
+            DocType docs[2];
+            std::vector<ValueType*> leaves[2];
+            uint32_t slots[2];
+            int current = 0;
     };
 
+    // walks a range of index entries from the largest value to the 
+    // smallest. entries with the same value stay in slot order, which 
+    // is the order a sort would leave them in.
+    class DescendingWalk {
+        public:
+            void reset(IndexIteratorRange range);
+            bool next(IndexSet::const_iterator& entry);
+
+            // continues from the entry that would come after (key, slot),
+            // which is the first entry with the key and a greater slot or
+            // the first entry with a smaller key.
+            void seek(const IndexSet& index, const Value& key, uint32_t slot);
+
+        private:
+            IndexIteratorRange range;
+            IndexSet::const_iterator pos;
+            IndexSet::const_iterator run;
+            IndexSet::const_iterator run_end;
+    };
 
     class LinearCursor : public BaseCursor {
         public:
-            LinearCursor(ValueType& list, const char* query);
+            LinearCursor(const Collection& collection, std::shared_ptr<const ParsedQuery> query);
             ~LinearCursor();
 
-            bool hasNext();
-            std::string next();
             uint32_t count();
-            const ValueType& nextAsJsonObj();
+
+            // notes the slot of each match. if the scan gets to the end, 
+            // they're left in the collection's result cache under the key.
+            void recordMatches(const std::string& key, uint64_t generation);
+
+        protected:
+            const ValueType* fetch();
+            bool orderBy(const SortKey& key);
+            bool seek(const ValueType* key, const char* after_id);
+            const ValueType* tokenKey(const ValueType& doc);
 
         private:
-            void findNext();
+            const ValueType* fetchByIndex();
+            void findUnindexed();
+            const ValueType* result(uint32_t domIdx);
+            void finish();
 
-            ValueType& list;
-            QueryExecutor exec;
-            ValueType::ConstValueIterator iter;
-            std::shared_ptr<QueryNode> head;
-            uint32_t limit;
-            uint32_t counter = 0;
-            bool has_next;
-    };
+            const Collection& collection;
+            const ValueType& list;
+            std::shared_ptr<const ParsedQuery> query;
+            uint32_t pos = 0;
 
-    // typedef so you can breath while reading this
-    // this is the type name of the pair that holds the start and end iterators 
-    // of a range of values in an index
-    typedef std::pair<
-        std::multimap<Spino::Value, uint32_t>::iterator, 
-        std::multimap<Spino::Value, uint32_t>::iterator
-            > IndexIteratorRange;
+            // a scan that reaches the end has counted the matches
+            uint32_t found = 0;
+            bool scanned = false;
+            bool from_start = true;
+            int64_t total = -1;
 
-    class EqIndexCursor : public BaseCursor {
+            bool recording = false;
+            std::string record_key;
+            uint64_t record_generation = 0;
+            std::vector<uint32_t> recorded;
+
+            // with more than one scan thread, blocks of the collection are 
+            // matched in parallel and the matches are buffered
+            bool parallel;
+            std::vector<uint32_t> matched;
+            size_t matched_pos = 0;
+            uint32_t block;
+
+            // when sorting by a field with an ordered index, the index is
+            // walked in order. documents the index doesn't have come last
+            // when ascending and first when descending.
+            const IndexSet* sort_index = nullptr;
+            PointerType sort_field;
+            int sort_direction = 1;
+            int phase = 0;
+            IndexSet::const_iterator index_pos;
+            DescendingWalk walk;
+            std::vector<const ValueType*> unindexed;
+            size_t unindexed_pos = 0;
+            bool unindexed_ready = false;
+    };
+
+    // walks a range of an ordered index. equality searches are a range
+    // of entries with the same value.
+    class RangeIndexCursor : public BaseCursor {
         public:
-            EqIndexCursor(IndexIteratorRange iter_range, ValueType& collection_dom);
-            ~EqIndexCursor();
+            RangeIndexCursor(IndexIteratorRange iter_range, const Collection& collection,
+                    const std::string& field_name);
+            ~RangeIndexCursor();
 
-            bool hasNext();
-            std::string next();
             uint32_t count();
-            const ValueType& nextAsJsonObj();
+
+        protected:
+            const ValueType* fetch();
+            bool orderBy(const SortKey& key);
+            bool seek(const ValueType* key, const char* after_id);
+            const ValueType* tokenKey(const ValueType& doc);
+            bool cover(const std::vector<std::string>& fields);
+            const ValueType* source(const ValueType* result);
 
         private:
-            ValueType& collection_dom;
+            const Collection& collection;
             IndexIteratorRange iter_range;
-            std::multimap<Spino::Value, uint32_t>::iterator iter;
-            uint32_t counter = 0;
-            string nextdoc;
+            IndexSet::const_iterator iter;
+            std::string field_name;
+            PointerType field;
+            bool descending = false;
+            DescendingWalk walk;
+            KeyDocument keys;
+    };
+
+    // iterates over a list of slots, such as the result of a hash index lookup.
+    // if there is a filter, only the documents that match it are returned.
+    class SlotCursor : public BaseCursor {
+        public:
+            SlotCursor(std::vector<uint32_t>&& slots, const Collection& collection, 
+                    std::shared_ptr<const ParsedQuery> filter = nullptr);
+            ~SlotCursor();
+
+            uint32_t count();
+
+            // the planner found every candidate in a range of a compound 
+            // index. if the filter only reads the indexed fields, it's 
+            // checked against the keys instead of the documents.
+            void setKeyRange(CompoundIteratorRange range, 
+                    const std::vector<std::string>& field_names);
+
+        protected:
+            const ValueType* fetch();
+            bool seek(const ValueType* key, const char* after_id);
+            bool cover(const std::vector<std::string>& fields);
+            const ValueType* source(const ValueType* result);
+
+        private:
+            bool matches(uint32_t slot, uint32_t& domIdx);
+            void loadEntries();
+            const ValueType* keyResult(const CompoundEntry& entry, KeyDocument& key_doc);
+
+            const Collection& collection;
+            std::vector<uint32_t> slots;
+            std::shared_ptr<const ParsedQuery> filter;
+            uint32_t pos = 0;
+
+            // the compound index entries of the candidates, in slot order
+            CompoundIteratorRange key_range;
+            std::vector<std::string> key_names;
+            std::vector<const CompoundEntry*> entries;
+            bool keyed = false;
+            KeyDocument keys;
     };
 
 }
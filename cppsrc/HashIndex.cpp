@@ -0,0 +1,286 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+
+#include "HashIndex.h"
+
+#include <cstring>
+
+namespace Spino {
+
+    HashIndex::HashIndex() {
+        clear();
+    }
+
+    void HashIndex::clear() {
+        keys.assign(INITIAL_CAPACITY, {0, EMPTY, EMPTY});
+        postings.assign(INITIAL_CAPACITY, {0, EMPTY, 0});
+        lists.clear();
+        free_lists.clear();
+        n_keys = 0;
+        n_postings = 0;
+        count = 0;
+    }
+
+    size_t HashIndex::memoryUsage() const {
+        size_t bytes = keys.size() * sizeof(Key) + postings.size() * sizeof(Posting);
+        bytes += lists.capacity() * sizeof(std::vector<uint32_t>);
+        for(auto& list : lists) {
+            bytes += list.capacity() * sizeof(uint32_t);
+        }
+        return bytes;
+    }
+
+    // entries are spread by their slot as well, so documents that share
+    // a value don't share a probe sequence
+    uint32_t HashIndex::postingHash(uint32_t hash, uint32_t slot) {
+        uint32_t h = hash ^ (slot * 0x9e3779b9u);
+        h ^= h >> 16;
+        h *= 0x85ebca6bu;
+        h ^= h >> 13;
+        return h;
+    }
+
+    uint32_t HashIndex::findKey(uint32_t hash) const {
+        uint32_t mask = keys.size() - 1;
+        uint32_t i = hash & mask;
+        while(keys[i].slot != EMPTY) {
+            if(keys[i].hash == hash) {
+                return i;
+            }
+            i = (i+1) & mask;
+        }
+        return EMPTY;
+    }
+
+    uint32_t HashIndex::findPosting(uint32_t hash, uint32_t slot) const {
+        uint32_t mask = postings.size() - 1;
+        uint32_t i = postingHash(hash, slot) & mask;
+        while(postings[i].slot != EMPTY) {
+            if((postings[i].hash == hash) && (postings[i].slot == slot)) {
+                return i;
+            }
+            i = (i+1) & mask;
+        }
+        return EMPTY;
+    }
+
+    void HashIndex::addPosting(uint32_t hash, uint32_t slot, uint32_t pos) {
+        uint32_t mask = postings.size() - 1;
+        uint32_t i = postingHash(hash, slot) & mask;
+        while(postings[i].slot != EMPTY) {
+            i = (i+1) & mask;
+        }
+        postings[i] = {hash, slot, pos};
+        n_postings++;
+    }
+
+    bool HashIndex::insert(uint32_t hash, uint32_t slot) {
+        // keep the load factors under 3/4 so probe sequences stay short
+        if((n_keys+1)*4 > keys.size()*3) {
+            growKeys();
+        }
+
+        uint32_t k = findKey(hash);
+        if(k == EMPTY) {
+            uint32_t mask = keys.size() - 1;
+            k = hash & mask;
+            while(keys[k].slot != EMPTY) {
+                k = (k+1) & mask;
+            }
+            keys[k] = {hash, slot, EMPTY};
+            n_keys++;
+            count++;
+            return true;
+        }
+
+        // the second slot for a hash moves both of them into a list
+        uint32_t added = (keys[k].list == EMPTY) ? 2 : 1;
+        while((n_postings+added)*4 > postings.size()*3) {
+            growPostings();
+        }
+
+        if(keys[k].list == EMPTY) {
+            uint32_t list;
+            if(free_lists.size()) {
+                list = free_lists.back();
+                free_lists.pop_back();
+            }
+            else {
+                list = lists.size();
+                lists.emplace_back();
+            }
+            lists[list].push_back(keys[k].slot);
+            addPosting(hash, keys[k].slot, 0);
+            keys[k].list = list;
+        }
+
+        auto& list = lists[keys[k].list];
+        addPosting(hash, slot, list.size());
+        list.push_back(slot);
+        count++;
+        return false;
+    }
+
+    bool HashIndex::erase(uint32_t hash, uint32_t slot) {
+        uint32_t k = findKey(hash);
+        if(k == EMPTY) {
+            return false;
+        }
+        if(keys[k].list == EMPTY) {
+            if(keys[k].slot != slot) {
+                return false;
+            }
+            eraseKey(k);
+            n_keys--;
+            count--;
+            return true;
+        }
+
+        uint32_t i = findPosting(hash, slot);
+        if(i == EMPTY) {
+            return false;
+        }
+        uint32_t list_id = keys[k].list;
+        auto& list = lists[list_id];
+
+        // move the last slot in the list into the hole
+        uint32_t pos = postings[i].pos;
+        uint32_t last = list.back();
+        if(last != slot) {
+            list[pos] = last;
+            postings[findPosting(hash, last)].pos = pos;
+        }
+        list.pop_back();
+        erasePosting(i);
+        count--;
+
+        // a hash that is down to one slot goes back to keeping it inline
+        if(list.size() == 1) {
+            erasePosting(findPosting(hash, list[0]));
+            keys[k].slot = list[0];
+            keys[k].list = EMPTY;
+            std::vector<uint32_t>().swap(list);
+            free_lists.push_back(list_id);
+        }
+        return false;
+    }
+
+    // shifts the following entries back so that there are no holes in 
+    // any probe sequence. this avoids the need for deleted markers.
+    void HashIndex::eraseKey(uint32_t i) {
+        uint32_t mask = keys.size() - 1;
+        uint32_t j = i;
+        while(true) {
+            j = (j+1) & mask;
+            if(keys[j].slot == EMPTY) {
+                break;
+            }
+            uint32_t home = keys[j].hash & mask;
+            bool stays = (i <= j) ? ((i < home) && (home <= j)) : ((i < home) || (home <= j));
+            if(!stays) {
+                keys[i] = keys[j];
+                i = j;
+            }
+        }
+        keys[i].slot = EMPTY;
+    }
+
+    void HashIndex::erasePosting(uint32_t i) {
+        uint32_t mask = postings.size() - 1;
+        uint32_t j = i;
+        while(true) {
+            j = (j+1) & mask;
+            if(postings[j].slot == EMPTY) {
+                break;
+            }
+            uint32_t home = postingHash(postings[j].hash, postings[j].slot) & mask;
+            bool stays = (i <= j) ? ((i < home) && (home <= j)) : ((i < home) || (home <= j));
+            if(!stays) {
+                postings[i] = postings[j];
+                i = j;
+            }
+        }
+        postings[i].slot = EMPTY;
+        n_postings--;
+    }
+
+    void HashIndex::growKeys() {
+        std::vector<Key> old;
+        old.swap(keys);
+        keys.assign(old.size()*2, {0, EMPTY, EMPTY});
+        uint32_t mask = keys.size() - 1;
+
+        for(auto& e : old) {
+            if(e.slot != EMPTY) {
+                uint32_t i = e.hash & mask;
+                while(keys[i].slot != EMPTY) {
+                    i = (i+1) & mask;
+                }
+                keys[i] = e;
+            }
+        }
+    }
+
+    void HashIndex::growPostings() {
+        std::vector<Posting> old;
+        old.swap(postings);
+        postings.assign(old.size()*2, {0, EMPTY, 0});
+        uint32_t mask = postings.size() - 1;
+
+        for(auto& e : old) {
+            if(e.slot != EMPTY) {
+                uint32_t i = postingHash(e.hash, e.slot) & mask;
+                while(postings[i].slot != EMPTY) {
+                    i = (i+1) & mask;
+                }
+                postings[i] = e;
+            }
+        }
+    }
+
+    // fnv-1a followed by a finalizer, because the low bits pick the bucket
+    uint32_t HashIndex::hashString(const char* s, size_t len) {
+        uint32_t hash = 2166136261u;
+        for(size_t i = 0; i < len; i++) {
+            hash ^= (unsigned char)s[i];
+            hash *= 16777619u;
+        }
+        hash ^= hash >> 16;
+        hash *= 0x85ebca6bu;
+        hash ^= hash >> 13;
+        return hash;
+    }
+
+    uint32_t HashIndex::hashNumber(double d) {
+        if(d == 0.0) {
+            d = 0.0; // -0 and 0 are equal
+        }
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        bits ^= bits >> 33;
+        bits *= 0xff51afd7ed558ccdULL;
+        bits ^= bits >> 33;
+        bits *= 0xc4ceb9fe1a85ec53ULL;
+        bits ^= bits >> 33;
+        return (uint32_t)bits;
+    }
+}
+
@@ -0,0 +1,111 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+#ifndef SPINO_HASHINDEX_H
+#define SPINO_HASHINDEX_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace Spino {
+
+    // an index of (hash, slot) entries for equality lookups. values aren't
+    // stored, so a match must be checked against the document itself. 
+    // each distinct hash is stored once, in an open addressing table. a 
+    // hash with one slot keeps it inline, which is the usual case for a 
+    // unique field. a hash with more slots spills them into a list, and a
+    // second table finds an entry's place in its list, so that neither 
+    // insert nor erase has to walk past the other slots with the same hash.
+    class HashIndex {
+        public:
+            HashIndex();
+
+            // insert returns true if no other entry has the hash. erase 
+            // returns true if it removed the last entry with the hash.
+            bool insert(uint32_t hash, uint32_t slot);
+            bool erase(uint32_t hash, uint32_t slot);
+            void clear();
+
+            // calls f(slot) for every entry with the hash, in no order
+            template <typename F>
+            void forEach(uint32_t hash, F f) const {
+                uint32_t k = findKey(hash);
+                if(k == EMPTY) {
+                    return;
+                }
+                if(keys[k].list == EMPTY) {
+                    f(keys[k].slot);
+                    return;
+                }
+                for(auto slot : lists[keys[k].list]) {
+                    f(slot);
+                }
+            }
+
+            size_t size() const { return count; }
+            size_t memoryUsage() const;
+
+            static uint32_t hashString(const char* s, size_t len);
+            static uint32_t hashNumber(double d);
+
+        private:
+            // a distinct hash and either its only slot, or the list of 
+            // its slots
+            struct Key {
+                uint32_t hash;
+                uint32_t slot;
+                uint32_t list;
+            };
+
+            // where a spilled entry is in the list for its hash
+            struct Posting {
+                uint32_t hash;
+                uint32_t slot;
+                uint32_t pos;
+            };
+
+            static uint32_t postingHash(uint32_t hash, uint32_t slot);
+
+            uint32_t findKey(uint32_t hash) const;
+            uint32_t findPosting(uint32_t hash, uint32_t slot) const;
+
+            void addPosting(uint32_t hash, uint32_t slot, uint32_t pos);
+            void growKeys();
+            void growPostings();
+            void eraseKey(uint32_t i);
+            void erasePosting(uint32_t i);
+
+            static const uint32_t EMPTY = UINT32_MAX;
+            static const uint32_t INITIAL_CAPACITY = 16;
+
+            // empty buckets have a slot of EMPTY. a key with a single slot
+            // has a list of EMPTY.
+            std::vector<Key> keys;
+            std::vector<Posting> postings;
+            std::vector<std::vector<uint32_t>> lists;
+            std::vector<uint32_t> free_lists;
+            uint32_t n_keys;
+            uint32_t n_postings;
+            uint32_t count;
+    };
+}
+
+#endif
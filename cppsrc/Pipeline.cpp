@@ -0,0 +1,528 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+#include "Pipeline.h"
+#include "Collection.h"
+#include "Cursor.h"
+#include "HashIndex.h"
+
+#include <algorithm>
+#include <list>
+#include <sstream>
+
+using namespace std;
+
+namespace Spino {
+    static PointerType pointerFromFieldName(const std::string& field_name) {
+        stringstream ss(field_name);
+        string intermediate;
+        string ptr;
+        while(getline(ss, intermediate, '.')) {
+            ptr += "/" + intermediate;
+        }
+        return PointerType(ptr.c_str());
+    }
+
+    // groups with a missing key are grouped with null
+    static const ValueType null_value;
+
+    static uint32_t hashValue(const ValueType& v) {
+        switch(v.GetType()) {
+            case rapidjson::kStringType:
+                return HashIndex::hashString(v.GetString(), v.GetStringLength());
+            case rapidjson::kNumberType:
+                return HashIndex::hashNumber(v.GetDouble());
+            case rapidjson::kTrueType:
+                return 0x9e3779b9;
+            case rapidjson::kFalseType:
+                return 0x7f4a7c15;
+            case rapidjson::kArrayType:
+                {
+                    uint32_t h = 0x2545f491;
+                    for(auto& e : v.GetArray()) {
+                        h = (h * 31) + hashValue(e);
+                    }
+                    return h;
+                }
+            case rapidjson::kObjectType:
+                {
+                    // objects are equal whatever order their members are in
+                    uint32_t h = 0x68e31da4;
+                    for(auto& m : v.GetObject()) {
+                        h += (hashValue(m.name) * 31) ^ hashValue(m.value);
+                    }
+                    return h;
+                }
+            default:
+                return 0;
+        }
+    }
+
+
+    // a hash table of groups and the state of their accumulators. 
+    // groups are kept in the order they were first seen. each scan 
+    // thread groups part of the documents and the parts are merged.
+    class Pipeline::Grouping {
+        public:
+            Grouping(const Stage& stage) : 
+                stage(stage),
+                n_keys(stage.key.size()),
+                n_accs(stage.accumulators.size()),
+                scratch(stage.key.size())
+            {
+                table.resize(16, 0);
+                mask = 15;
+            }
+
+            void add(const ValueType& doc) {
+                uint32_t h = 0;
+                for(size_t i = 0; i < n_keys; i++) {
+                    auto v = stage.key[i].get(doc);
+                    scratch[i] = v ? v : &null_value;
+                    h = (h * 31) + hashValue(*scratch[i]);
+                }
+
+                uint32_t g = find(scratch.data(), h);
+                Acc* acc = accs.data() + g * n_accs;
+                for(size_t i = 0; i < n_accs; i++) {
+                    auto& spec = stage.accumulators[i];
+                    if(spec.kind == ACC_COUNT) {
+                        acc[i].count++;
+                        continue;
+                    }
+
+                    auto v = spec.arg.get(doc);
+                    if((v == nullptr) || v->IsNull()) {
+                        continue;
+                    }
+                    if((spec.kind == ACC_SUM) || (spec.kind == ACC_AVG)) {
+                        if(v->IsNumber()) {
+                            acc[i].addNumber(*v);
+                        }
+                    }
+                    else {
+                        keepBest(spec.kind, acc[i], v);
+                    }
+                }
+            }
+
+            void merge(const Grouping& other) {
+                for(size_t g = 0; g < other.hashes.size(); g++) {
+                    uint32_t to = find(other.keys.data() + g * n_keys, other.hashes[g]);
+                    Acc* acc = accs.data() + to * n_accs;
+                    const Acc* src = other.accs.data() + g * n_accs;
+                    for(size_t i = 0; i < n_accs; i++) {
+                        acc[i].count += src[i].count;
+                        acc[i].sum += src[i].sum;
+                        acc[i].isum += src[i].isum;
+                        acc[i].integral = acc[i].integral && src[i].integral;
+                        if(src[i].best) {
+                            keepBest(stage.accumulators[i].kind, acc[i], src[i].best);
+                        }
+                    }
+                }
+            }
+
+            // appends a document for each group to the array
+            void write(DocType& out) const {
+                auto& a = out.GetAllocator();
+                for(size_t g = 0; g < hashes.size(); g++) {
+                    ValueType doc(rapidjson::kObjectType);
+                    const ValueType* const* key = keys.data() + g * n_keys;
+                    if(stage.key_names.empty()) {
+                        ValueType id;
+                        if(n_keys) {
+                            id.CopyFrom(*key[0], a, true);
+                        }
+                        doc.AddMember("_id", id, a);
+                    }
+                    else {
+                        ValueType id(rapidjson::kObjectType);
+                        for(size_t i = 0; i < n_keys; i++) {
+                            ValueType name(stage.key_names[i].c_str(), a);
+                            ValueType v;
+                            v.CopyFrom(*key[i], a, true);
+                            id.AddMember(name, v, a);
+                        }
+                        doc.AddMember("_id", id, a);
+                    }
+
+                    const Acc* acc = accs.data() + g * n_accs;
+                    for(size_t i = 0; i < n_accs; i++) {
+                        auto& spec = stage.accumulators[i];
+                        ValueType name(spec.name.c_str(), a);
+                        ValueType v;
+                        switch(spec.kind) {
+                            case ACC_COUNT:
+                                v.SetUint64(acc[i].count);
+                                break;
+                            case ACC_SUM:
+                                if(acc[i].integral) {
+                                    v.SetInt64(acc[i].isum);
+                                }
+                                else {
+                                    v.SetDouble(acc[i].sum);
+                                }
+                                break;
+                            case ACC_AVG:
+                                if(acc[i].count) {
+                                    v.SetDouble(acc[i].sum / acc[i].count);
+                                }
+                                break;
+                            default:
+                                if(acc[i].best) {
+                                    v.CopyFrom(*acc[i].best, a, true);
+                                }
+                        }
+                        doc.AddMember(name, v, a);
+                    }
+                    out.PushBack(doc, a);
+                }
+            }
+
+        private:
+            struct Acc {
+                uint64_t count = 0;
+                double sum = 0.0;
+
+                // sums of whole numbers are kept exactly
+                int64_t isum = 0;
+                bool integral = true;
+
+                // the smallest or largest value
+                const ValueType* best = nullptr;
+
+                void addNumber(const ValueType& v) {
+                    count++;
+                    sum += v.GetDouble();
+                    if(v.IsInt64()) {
+                        isum += v.GetInt64();
+                    }
+                    else {
+                        integral = false;
+                    }
+                }
+            };
+
+            static void keepBest(AccumulatorKind kind, Acc& acc, const ValueType* v) {
+                if(acc.best == nullptr) {
+                    acc.best = v;
+                    return;
+                }
+                int cmp = compareValues(v, acc.best);
+                if((kind == ACC_MIN) ? (cmp < 0) : (cmp > 0)) {
+                    acc.best = v;
+                }
+            }
+
+            // finds the group with the key, adding it if there isn't one
+            uint32_t find(const ValueType* const* key, uint32_t h) {
+                uint32_t i = h & mask;
+                while(table[i] != 0) {
+                    uint32_t g = table[i] - 1;
+                    if(hashes[g] == h) {
+                        const ValueType* const* other = keys.data() + g * n_keys;
+                        size_t k = 0;
+                        while((k < n_keys) && (*key[k] == *other[k])) {
+                            k++;
+                        }
+                        if(k == n_keys) {
+                            return g;
+                        }
+                    }
+                    i = (i+1) & mask;
+                }
+
+                uint32_t g = hashes.size();
+                hashes.push_back(h);
+                keys.insert(keys.end(), key, key + n_keys);
+                accs.resize(accs.size() + n_accs);
+                table[i] = g + 1;
+                if(hashes.size() * 2 > table.size()) {
+                    grow();
+                }
+                return g;
+            }
+
+            void grow() {
+                table.assign(table.size() * 2, 0);
+                mask = table.size() - 1;
+                for(uint32_t g = 0; g < hashes.size(); g++) {
+                    uint32_t i = hashes[g] & mask;
+                    while(table[i] != 0) {
+                        i = (i+1) & mask;
+                    }
+                    table[i] = g + 1;
+                }
+            }
+
+            const Stage& stage;
+            size_t n_keys;
+            size_t n_accs;
+
+            // the keys and accumulators of each group are stored together
+            std::vector<const ValueType*> keys;
+            std::vector<uint32_t> hashes;
+            std::vector<Acc> accs;
+
+            // group numbers plus one. zero is an empty bucket.
+            std::vector<uint32_t> table;
+            uint32_t mask;
+            std::vector<const ValueType*> scratch;
+    };
+
+
+    Pipeline::Pipeline(const char* text, QueryCache& query_cache) {
+        pipeline.Parse(text);
+        if(pipeline.HasParseError()) {
+            throw parse_error("Pipeline is not valid JSON");
+        }
+        if(!pipeline.IsArray()) {
+            throw parse_error("Pipeline must be an array of stages");
+        }
+
+        for(auto& s : pipeline.GetArray()) {
+            if(!s.IsObject() || (s.MemberCount() != 1)) {
+                throw parse_error("Each stage must be an object with one member");
+            }
+            std::string name = s.MemberBegin()->name.GetString();
+            const ValueType& spec = s.MemberBegin()->value;
+
+            Stage stage;
+            if(name == "$match") {
+                stage.kind = STAGE_MATCH;
+                if(!spec.IsString()) {
+                    throw parse_error("$match must be a query string");
+                }
+                stage.query = query_cache.get(spec.GetString());
+            }
+            else if(name == "$group") {
+                stage.kind = STAGE_GROUP;
+                parseGroup(spec, stage);
+            }
+            else if(name == "$count") {
+                stage.kind = STAGE_COUNT;
+                if(!spec.IsString() || (spec.GetStringLength() == 0)) {
+                    throw parse_error("$count must be a field name");
+                }
+                stage.count_name = spec.GetString();
+            }
+            else if(name == "$sort") {
+                stage.kind = STAGE_SORT;
+                if(!spec.IsObject() || (spec.MemberCount() == 0)) {
+                    throw parse_error("$sort must be an object of fields");
+                }
+                for(auto& m : spec.GetObject()) {
+                    if(!m.value.IsNumber() || (m.value.GetDouble() == 0)) {
+                        throw parse_error("$sort directions must be 1 or -1");
+                    }
+                    stage.sort.push_back({
+                            pointerFromFieldName(m.name.GetString()), 
+                            (m.value.GetDouble() < 0) ? -1 : 1});
+                }
+            }
+            else if((name == "$skip") || (name == "$limit")) {
+                stage.kind = (name == "$skip") ? STAGE_SKIP : STAGE_LIMIT;
+                if(!spec.IsUint()) {
+                    throw parse_error(name + " must be a positive whole number");
+                }
+                stage.n = spec.GetUint();
+            }
+            else {
+                throw parse_error("Unknown stage " + name);
+            }
+            stages.push_back(std::move(stage));
+        }
+    }
+
+    Pipeline::Expression Pipeline::parseExpression(const ValueType& v) const {
+        Expression e;
+        if(v.IsString() && (v.GetStringLength() > 1) && (v.GetString()[0] == '$')) {
+            e.is_field = true;
+            e.field = pointerFromFieldName(v.GetString() + 1);
+        }
+        else if(v.IsObject() || v.IsArray()) {
+            throw parse_error("Expressions must be a \"$field\" or a constant");
+        }
+        else {
+            e.constant = &v;
+        }
+        return e;
+    }
+
+    void Pipeline::parseGroup(const ValueType& spec, Stage& stage) const {
+        if(!spec.IsObject() || !spec.HasMember("_id")) {
+            throw parse_error("$group must have an _id");
+        }
+
+        for(auto& m : spec.GetObject()) {
+            std::string name = m.name.GetString();
+            if(name == "_id") {
+                // a null _id puts every document in one group
+                if(m.value.IsObject()) {
+                    for(auto& k : m.value.GetObject()) {
+                        stage.key_names.push_back(k.name.GetString());
+                        stage.key.push_back(parseExpression(k.value));
+                    }
+                }
+                else if(!m.value.IsNull()) {
+                    stage.key.push_back(parseExpression(m.value));
+                }
+                continue;
+            }
+
+            if(!m.value.IsObject() || (m.value.MemberCount() != 1)) {
+                throw parse_error("Group field " + name + " must have one accumulator");
+            }
+            std::string op = m.value.MemberBegin()->name.GetString();
+            Accumulator acc;
+            acc.name = name;
+            if(op == "$sum") {
+                acc.kind = ACC_SUM;
+            }
+            else if(op == "$avg") {
+                acc.kind = ACC_AVG;
+            }
+            else if(op == "$min") {
+                acc.kind = ACC_MIN;
+            }
+            else if(op == "$max") {
+                acc.kind = ACC_MAX;
+            }
+            else if(op == "$count") {
+                acc.kind = ACC_COUNT;
+            }
+            else {
+                throw parse_error("Unknown accumulator " + op);
+            }
+            if(acc.kind != ACC_COUNT) {
+                acc.arg = parseExpression(m.value.MemberBegin()->value);
+            }
+            stage.accumulators.push_back(acc);
+        }
+    }
+
+    std::shared_ptr<const ParsedQuery> Pipeline::firstMatch() const {
+        if(stages.size() && (stages[0].kind == STAGE_MATCH)) {
+            return stages[0].query;
+        }
+        return nullptr;
+    }
+
+    void Pipeline::group(const Stage& stage, const Collection& collection,
+            const std::vector<const ValueType*>& docs, DocType& out) const {
+        out.SetArray();
+        uint32_t n_tasks = collection.scanTasks(docs.size());
+        if(n_tasks < 2) {
+            Grouping g(stage);
+            for(auto d : docs) {
+                g.add(*d);
+            }
+            g.write(out);
+            return;
+        }
+
+        // each thread groups a part of the documents. merging the parts 
+        // in order keeps the groups in the order they were first seen.
+        std::vector<std::unique_ptr<Grouping>> parts;
+        for(uint32_t t = 0; t < n_tasks; t++) {
+            parts.emplace_back(new Grouping(stage));
+        }
+        size_t step = (docs.size() + n_tasks - 1) / n_tasks;
+        collection.runTasks(n_tasks, [&](uint32_t t) {
+            size_t end = std::min(docs.size(), (t+1) * step);
+            for(size_t i = t * step; i < end; i++) {
+                parts[t]->add(*docs[i]);
+            }
+        });
+        for(uint32_t t = 1; t < n_tasks; t++) {
+            parts[0]->merge(*parts[t]);
+        }
+        parts[0]->write(out);
+    }
+
+    std::string Pipeline::run(const Collection& collection, 
+            std::vector<const ValueType*>& docs) const {
+        // documents made by $group and $count
+        std::list<DocType> made;
+
+        for(size_t i = firstMatch() ? 1 : 0; i < stages.size(); i++) {
+            auto& stage = stages[i];
+            switch(stage.kind) {
+                case STAGE_MATCH:
+                    docs.erase(std::remove_if(docs.begin(), docs.end(), 
+                                [&](const ValueType* d) {
+                                    return !stage.query->program.matches(*d);
+                                }), docs.end());
+                    break;
+                case STAGE_GROUP:
+                    {
+                        made.emplace_back();
+                        DocType& out = made.back();
+                        group(stage, collection, docs, out);
+                        docs.clear();
+                        for(auto& d : out.GetArray()) {
+                            docs.push_back(&d);
+                        }
+                    }
+                    break;
+                case STAGE_COUNT:
+                    {
+                        made.emplace_back();
+                        DocType& out = made.back();
+                        out.SetObject();
+                        ValueType name(stage.count_name.c_str(), out.GetAllocator());
+                        out.AddMember(name, (uint64_t)docs.size(), out.GetAllocator());
+                        docs.assign(1, &out);
+                    }
+                    break;
+                case STAGE_SORT:
+                    std::stable_sort(docs.begin(), docs.end(), 
+                            [&](const ValueType* a, const ValueType* b) {
+                                for(auto& key : stage.sort) {
+                                    int cmp = compareValues(key.field.Get(*a), key.field.Get(*b));
+                                    if(cmp != 0) {
+                                        return (cmp * key.direction) < 0;
+                                    }
+                                }
+                                return false;
+                            });
+                    break;
+                case STAGE_SKIP:
+                    docs.erase(docs.begin(), docs.begin() + std::min<size_t>(stage.n, docs.size()));
+                    break;
+                case STAGE_LIMIT:
+                    if(docs.size() > stage.n) {
+                        docs.resize(stage.n);
+                    }
+                    break;
+            }
+        }
+
+        rapidjson::StringBuffer sb;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+        writer.StartArray();
+        for(auto d : docs) {
+            d->Accept(writer);
+        }
+        writer.EndArray();
+        return sb.GetString();
+    }
+}
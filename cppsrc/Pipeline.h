@@ -0,0 +1,123 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+#ifndef SPINO_PIPELINE_H
+#define SPINO_PIPELINE_H
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "QueryNodes.h"
+#include "QueryParser.h"
+#include "QueryCache.h"
+
+namespace Spino {
+    class Collection;
+
+    // an aggregation pipeline. it is a JSON array of stages such as
+    // [{"$match": "{type: \"book\"}"}, 
+    //  {"$group": {"_id": "$author", "books": {"$sum": 1}}}]
+    // the stages are $match, $group, $count, $sort, $skip and $limit.
+    // the constructor throws parse_error if the pipeline isn't valid.
+    class Pipeline {
+        public:
+            Pipeline(const char* pipeline, QueryCache& query_cache);
+
+            // the query of the first stage if it is a $match, otherwise 
+            // nullptr. the collection finds its documents with an index 
+            // if it can and passes them to run().
+            std::shared_ptr<const ParsedQuery> firstMatch() const;
+
+            // runs the rest of the stages and writes the results as 
+            // a JSON array
+            std::string run(const Collection& collection, 
+                    std::vector<const ValueType*>& docs) const;
+
+        private:
+            enum StageKind {
+                STAGE_MATCH,
+                STAGE_GROUP,
+                STAGE_COUNT,
+                STAGE_SORT,
+                STAGE_SKIP,
+                STAGE_LIMIT
+            };
+
+            enum AccumulatorKind {
+                ACC_SUM,
+                ACC_AVG,
+                ACC_MIN,
+                ACC_MAX,
+                ACC_COUNT
+            };
+
+            // a field of the document, such as "$price", or a constant
+            struct Expression {
+                bool is_field = false;
+                PointerType field;
+                const ValueType* constant = nullptr;
+
+                // returns nullptr if the document doesn't have the field
+                const ValueType* get(const ValueType& doc) const {
+                    return is_field ? field.Get(doc) : constant;
+                }
+            };
+
+            struct Accumulator {
+                std::string name;
+                AccumulatorKind kind;
+                Expression arg;
+            };
+
+            struct SortKey {
+                PointerType field;
+                int direction;
+            };
+
+            struct Stage {
+                StageKind kind;
+                std::shared_ptr<const ParsedQuery> query;
+
+                // the _id of a group is one expression or an object 
+                // of them. key_names is empty for one expression.
+                std::vector<std::string> key_names;
+                std::vector<Expression> key;
+                std::vector<Accumulator> accumulators;
+
+                std::vector<SortKey> sort;
+                std::string count_name;
+                uint32_t n = 0;
+            };
+
+            class Grouping;
+
+            Expression parseExpression(const ValueType& v) const;
+            void parseGroup(const ValueType& spec, Stage& stage) const;
+            void group(const Stage& stage, const Collection& collection,
+                    const std::vector<const ValueType*>& docs, DocType& out) const;
+
+            // the parsed pipeline holds the constants of the expressions
+            DocType pipeline;
+            std::vector<Stage> stages;
+    };
+}
+
+#endif
@@ -0,0 +1,97 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+
+#include "PreparedQuery.h"
+
+#include <iostream>
+
+namespace Spino {
+
+    PreparedQuery::PreparedQuery(const char* query) {
+        // prepared queries aren't shared through the query cache because
+        // each one has its own bindings
+        parsed = std::make_shared<ParsedQuery>(query);
+
+        targets.resize(parsed->parameter_count);
+        if(parsed->bfc && (parsed->bfc->parameter >= 0)) {
+            targets[parsed->bfc->parameter].push_back(&parsed->bfc->v);
+        }
+        findParameters(parsed->head);
+    }
+
+    void PreparedQuery::findParameters(std::shared_ptr<QueryNode> node) {
+        if(auto bfc = std::dynamic_pointer_cast<BasicFieldComparison>(node)) {
+            if(bfc->parameter >= 0) {
+                targets[bfc->parameter].push_back(&bfc->v);
+            }
+        }
+        else if(auto f = std::dynamic_pointer_cast<Field>(node)) {
+            findParameters(f->operation);
+        }
+        else if(auto op = std::dynamic_pointer_cast<Operator>(node)) {
+            findParameters(op->cmp);
+        }
+        else if(auto l = std::dynamic_pointer_cast<LogicalExpression>(node)) {
+            for(auto& n : l->fields) {
+                findParameters(n);
+            }
+        }
+        else if(auto l = std::dynamic_pointer_cast<List>(node)) {
+            for(auto& n : l->list) {
+                findParameters(n);
+            }
+        }
+        else if(auto p = std::dynamic_pointer_cast<Parameter>(node)) {
+            targets[p->index].push_back(&p->value);
+        }
+    }
+
+    bool PreparedQuery::bindNumber(uint32_t index, double v) {
+        bound.type = TYPE_NUMERIC;
+        bound.numeric = v;
+        return bind(index);
+    }
+
+    bool PreparedQuery::bindString(uint32_t index, const char* s) {
+        bound.type = TYPE_STRING;
+        bound.str.assign(s);
+        return bind(index);
+    }
+
+    bool PreparedQuery::bindBool(uint32_t index, bool b) {
+        bound.type = TYPE_BOOLEAN;
+        bound.boolean = b;
+        return bind(index);
+    }
+
+    bool PreparedQuery::bind(uint32_t index) {
+        if(index >= targets.size()) {
+            cout << "SpinoDB:: parameter " << index << " is out of range" << endl;
+            return false;
+        }
+        for(auto v : targets[index]) {
+            *v = bound;
+        }
+        parsed->program.bind(index, bound);
+        return true;
+    }
+}
+
@@ -0,0 +1,63 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+#ifndef SPINO_PREPARED_QUERY_H
+#define SPINO_PREPARED_QUERY_H
+
+#include "QueryCache.h"
+
+namespace Spino {
+
+    // a query that is parsed once and run many times with different values.
+    // values are written as ? placeholders and are numbered from 0 in the
+    // order they appear, for example {name: ?, score: {$gt: ?}}.
+    // a query with a placeholder that hasn't been bound yet doesn't match
+    // any document, so an update or drop with it leaves the collection 
+    // alone. changing a binding also changes the results of cursors that 
+    // are still open on the query.
+    class PreparedQuery {
+        public:
+            // throws parse_error if the query can't be parsed
+            explicit PreparedQuery(const char* query);
+
+            uint32_t parameterCount() const { return targets.size(); }
+
+            // true once every placeholder has a value
+            bool isBound() const { return parsed->program.allBound(); }
+
+            // returns false if the index is out of range
+            bool bindNumber(uint32_t index, double v);
+            bool bindString(uint32_t index, const char* s);
+            bool bindBool(uint32_t index, bool b);
+
+            std::shared_ptr<const ParsedQuery> getQuery() const { return parsed; }
+
+        private:
+            bool bind(uint32_t index);
+            void findParameters(std::shared_ptr<QueryNode> node);
+
+            std::shared_ptr<ParsedQuery> parsed;
+            // every copy of each placeholder's value in the syntax tree
+            std::vector<std::vector<Value*>> targets;
+            Value bound;
+    };
+}
+
+#endif
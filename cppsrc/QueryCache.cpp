@@ -0,0 +1,92 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+
+#include "QueryCache.h"
+#include "HashIndex.h"
+
+#include <cstring>
+
+namespace Spino {
+
+    QueryCache::QueryCache(size_t capacity) : 
+        capacity(capacity), hits(0), misses(0) {
+    }
+
+    ParsedQuery::ParsedQuery(const char* query) {
+        QueryParser bfc_parser(query);
+        bfc = bfc_parser.parse_basic_comparison();
+
+        QueryParser parser(query);
+        head = parser.parse_expression();
+        program.compile(head);
+        parameter_count = parser.parameter_count();
+    }
+
+    std::shared_ptr<const ParsedQuery> QueryCache::get(const char* query) {
+        if(capacity == 0) {
+            misses++;
+            return std::make_shared<ParsedQuery>(query);
+        }
+
+        // entries are found by the hash of the query. the text is 
+        // compared as well, in case two queries have the same hash.
+        size_t len = strlen(query);
+        uint32_t hash = HashIndex::hashString(query, len);
+        auto found = map.find(hash);
+        if(found != map.end()) {
+            auto entry = found->second;
+            if((entry->query.size() == len) && (memcmp(entry->query.data(), query, len) == 0)) {
+                hits++;
+                lru.splice(lru.begin(), lru, entry);
+                return entry->parsed;
+            }
+            lru.erase(entry);
+            map.erase(found);
+        }
+
+        misses++;
+        auto parsed = std::make_shared<const ParsedQuery>(query);
+        lru.push_front({hash, std::string(query, len), parsed});
+        map[hash] = lru.begin();
+        evict();
+        return parsed;
+    }
+
+    void QueryCache::setCapacity(size_t c) {
+        capacity = c;
+        evict();
+    }
+
+    void QueryCache::clear() {
+        lru.clear();
+        map.clear();
+        hits = 0;
+        misses = 0;
+    }
+
+    void QueryCache::evict() {
+        while(lru.size() > capacity) {
+            map.erase(lru.back().hash);
+            lru.pop_back();
+        }
+    }
+}
+
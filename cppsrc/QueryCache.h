@@ -0,0 +1,82 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+#ifndef SPINO_QUERY_CACHE_H
+#define SPINO_QUERY_CACHE_H
+
+#include <list>
+#include <unordered_map>
+#include "QueryParser.h"
+#include "QueryProgram.h"
+
+namespace Spino {
+
+    // a parsed and compiled query. cursors hold on to it, so it stays
+    // valid after it has been evicted from the cache.
+    struct ParsedQuery {
+        // throws parse_error if the query can't be parsed
+        ParsedQuery(const char* query);
+
+        // set if the query is a single comparison of a field to a value
+        std::shared_ptr<BasicFieldComparison> bfc;
+        std::shared_ptr<QueryNode> head;
+        QueryProgram program;
+        uint32_t parameter_count;
+    };
+
+    // a least recently used cache of parsed queries, keyed by query text.
+    // applications tend to run the same few queries over and over, so 
+    // this saves lexing, parsing and compiling regexes on every call.
+    class QueryCache {
+        public:
+            QueryCache(size_t capacity = 512);
+
+            // throws parse_error if the query can't be parsed
+            std::shared_ptr<const ParsedQuery> get(const char* query);
+
+            // a capacity of zero turns the cache off
+            void setCapacity(size_t capacity);
+            size_t getCapacity() const { return capacity; }
+
+            void clear();
+            size_t size() const { return lru.size(); }
+            uint64_t getHits() const { return hits; }
+            uint64_t getMisses() const { return misses; }
+
+        private:
+            struct Entry {
+                uint32_t hash;
+                std::string query;
+                std::shared_ptr<const ParsedQuery> parsed;
+            };
+            typedef std::list<Entry> LruList;
+
+            void evict();
+
+            // most recently used first
+            LruList lru;
+            std::unordered_map<uint32_t, LruList::iterator> map;
+            size_t capacity;
+            uint64_t hits;
+            uint64_t misses;
+    };
+}
+
+#endif
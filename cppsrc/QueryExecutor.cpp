@@ -22,7 +22,6 @@
 #include "QueryExecutor.h"
 #include "QueryParser.h"
 
-#include <regex>
 
 
 namespace Spino {
@@ -56,6 +55,15 @@ namespace Spino {
         v.type = TYPE_BOOLEAN;
     }
 
+    void QueryExecutor::Visit(Parameter* p) {
+        Value& v = stack[stack_ptr++];
+        if(stack_ptr == stack.size()) {
+            stack.resize(stack.size() + 100);
+        }
+
+        v = p->value;
+    }
+
     void QueryExecutor::Visit(Field* f) {
         Value& v = stack[stack_ptr++];
         if(stack_ptr == stack.size()) {
@@ -102,6 +110,7 @@ namespace Spino {
             // the AND query is false. the stack has a false already on it.
             if((l->op == TOK_AND) && (a.boolean == false)) {
                 a.type = TYPE_BOOLEAN;
+                stack_ptr++;
                 return;
             }
 
@@ -110,9 +119,15 @@ namespace Spino {
             //so we just return here
             if((l->op == TOK_OR) && (a.boolean == true)) {
                 a.type = TYPE_BOOLEAN;
+                stack_ptr++;
                 return;
             }
         }
+
+        // every clause was checked. the result is the last clause's result,
+        // which is still on the stack. push it back so that nested 
+        // expressions have a value to pop
+        stack[stack_ptr++].type = TYPE_BOOLEAN;
     }
 
     void QueryExecutor::Visit(List* l) {
@@ -147,28 +162,38 @@ namespace Spino {
                 }
                 break;
             case TOK_GREATER_THAN: 
-                {
-                    auto& b = stack[--stack_ptr];
-                    auto& a = stack[--stack_ptr];
-                    bool boolean = false;
-
-                    if(a.numeric > b.numeric) {
-                        boolean = true;
-                    }	
-                    Value& v = stack[stack_ptr++];
-                    v.type = TYPE_BOOLEAN;
-                    v.boolean = boolean;
-                }
-                break;
             case TOK_LESS_THAN:
+            case TOK_GREATER_THAN_EQUAL:
+            case TOK_LESS_THAN_EQUAL:
                 {
-                    auto& b = stack[--stack_ptr];
-                    auto& a = stack[--stack_ptr];
+                    auto& rhs = stack[--stack_ptr];
+                    auto& lhs = stack[--stack_ptr];
                     bool boolean = false;
 
-                    if(a.numeric < b.numeric) {
-                        boolean = true;
+                    // numbers are compared with numbers and strings with strings.
+                    // anything else never matches. this is the same order 
+                    // the indices use, so range scans give the same results.
+                    int cmp = 0;
+                    bool comparable = true;
+                    if((lhs.type == TYPE_NUMERIC) && (rhs.type == TYPE_NUMERIC)) {
+                        cmp = (lhs.numeric < rhs.numeric) ? -1 : ((lhs.numeric > rhs.numeric) ? 1 : 0);
+                    }
+                    else if((lhs.type == TYPE_STRING) && (rhs.type == TYPE_STRING)) {
+                        cmp = lhs.str.compare(rhs.str);
                     }
+                    else {
+                        comparable = false;
+                    }
+
+                    if(comparable) {
+                        switch(a->op) {
+                            case TOK_GREATER_THAN: boolean = (cmp > 0); break;
+                            case TOK_LESS_THAN: boolean = (cmp < 0); break;
+                            case TOK_GREATER_THAN_EQUAL: boolean = (cmp >= 0); break;
+                            case TOK_LESS_THAN_EQUAL: boolean = (cmp <= 0); break;
+                        }
+                    }
+
                     Value& v = stack[stack_ptr++];
                     v.type = TYPE_BOOLEAN;
                     v.boolean = boolean;
@@ -326,8 +351,7 @@ namespace Spino {
     void QueryExecutor::Visit(RegexNode* rn) {
         Value& v = stack[stack_ptr-1];
         if(v.type == TYPE_STRING) {
-            std::smatch base_match;
-            v.boolean = std::regex_match(v.str, base_match, rn->base_regex);
+            v.boolean = rn->regex->match(v.str);
         }
         else {
             v.boolean = false;
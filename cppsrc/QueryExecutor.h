@@ -25,7 +25,6 @@
 #include <string>
 #include <vector>
 #include <memory>
-#include <regex>
 #include <cmath>
 #include "rapidjson/rapidjson.h"
 #include "rapidjson/pointer.h"
@@ -39,8 +38,12 @@
 
 
 namespace Spino {
-	typedef rapidjson::GenericDocument<rapidjson::UTF8<>, rapidjson::CrtAllocator, rapidjson::CrtAllocator> DocType;
-	typedef rapidjson::GenericValue<rapidjson::UTF8<>, rapidjson::CrtAllocator> ValueType;
+	// documents are allocated from memory pools. each collection owns a pool
+	// so appending is a pointer bump and dropping a collection releases 
+	// all of its documents at once. 
+	typedef rapidjson::MemoryPoolAllocator<rapidjson::CrtAllocator> AllocatorType;
+	typedef rapidjson::GenericDocument<rapidjson::UTF8<>, AllocatorType, rapidjson::CrtAllocator> DocType;
+	typedef rapidjson::GenericValue<rapidjson::UTF8<>, AllocatorType> ValueType;
 	typedef rapidjson::GenericPointer<ValueType> PointerType;
 
 
@@ -143,6 +146,7 @@ namespace Spino {
 			void Visit(class NumericValue* f);
 			void Visit(class StringValue* s);
 			void Visit(class BoolValue* b);
+			void Visit(class Parameter* p);
 			void Visit(class RegexNode* rn);
 			void Visit(class Field* f);
 			void Visit(class LogicalExpression* l);
@@ -23,6 +23,7 @@
 #define QUERY_NODES_H
 
 #include "QueryExecutor.h"
+#include "Regex.h"
 
 namespace Spino {
 	// base node type
@@ -60,9 +61,22 @@ namespace Spino {
 	};
 
 
+	// a ? placeholder in a prepared query. 
+	// value is undefined until a value is bound to it
+	class Parameter: public QueryNode {
+		public:
+			uint32_t index;
+			Value value;
+
+			virtual void Accept(QueryExecutor* t) {
+				t->Visit(this);
+			}
+	};
+
+
 	class RegexNode: public QueryNode {
 		public:
-			std::regex base_regex;
+			std::shared_ptr<const Regex> regex;
 
 			virtual void Accept(QueryExecutor* t) {
 				t->Visit(this);
@@ -75,6 +89,7 @@ namespace Spino {
 	// loads the field, checks if it is equal to 10
 	class Field: public QueryNode {
 		public:
+			std::string field_name;
 			std::shared_ptr<Operator> operation;
 			PointerType jp;
 
@@ -84,7 +99,7 @@ namespace Spino {
 	};
 
 	// a logical expression such as AND or OR
-	// op is the expression and may be  TOK_AND, TOK_OR
+	// op is the expression and may be  TOK_AND, TOK_OR, TOK_NOR
 	// fields are the list of fields (with their respective operations) to load
 	class LogicalExpression: public QueryNode {
 		public:
@@ -107,8 +122,9 @@ namespace Spino {
 	};
 
 	// an operator
-	// op may be $eq, $ne, $gt, $lt, $in, $nin, $exists, $type
-	// cmp is the node to perform the operation on
+	// op may be $eq, $ne, $gt, $lt, $gte, $lte, $in, $nin, $exists, $type,
+	// $size or $elemMatch. cmp is the node to perform the operation on. for
+	// $elemMatch it is the expression each element is matched with
 	// an operator always leaves a true/false on top of the stack
 	class Operator: public QueryNode {
 		public:
@@ -125,11 +141,36 @@ namespace Spino {
 			std::string field_name;
 			PointerType jp;
 			Value v;
+			// the index of the placeholder if v is a bound parameter, otherwise -1
+			int32_t parameter = -1;
 
 			virtual void Accept(QueryExecutor* t) {
 				t->Visit(this);
 			}
 	};
+
+	// gets the value of a literal node or a bound parameter
+	inline bool literalValue(const std::shared_ptr<QueryNode>& node, Value& v) {
+		if(auto n = std::dynamic_pointer_cast<NumericValue>(node)) {
+			v.type = TYPE_NUMERIC;
+			v.numeric = n->value;
+		}
+		else if(auto s = std::dynamic_pointer_cast<StringValue>(node)) {
+			v.type = TYPE_STRING;
+			v.str = s->value;
+		}
+		else if(auto b = std::dynamic_pointer_cast<BoolValue>(node)) {
+			v.type = TYPE_BOOLEAN;
+			v.boolean = b->value;
+		}
+		else if(auto p = std::dynamic_pointer_cast<Parameter>(node)) {
+			v = p->value;
+		}
+		else {
+			return false;
+		}
+		return true;
+	}
 }
 
 
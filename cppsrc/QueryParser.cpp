@@ -78,6 +78,9 @@ Token QueryParser::lex() {
 			case ',':
 				next();
 				return Token(TOK_COMMA, ",");
+			case '?':
+				next();
+				return Token(TOK_PARAMETER, "?");
 			case '"':
 				return Token(TOK_STRING_LITERAL, read_string_literal());
 			case '$':
@@ -92,6 +95,12 @@ Token QueryParser::lex() {
 				else if(op == "$lt") {
 					return Token(TOK_LESS_THAN, op);
 				}
+				else if(op == "$gte") {
+					return Token(TOK_GREATER_THAN_EQUAL, op);
+				}
+				else if(op == "$lte") {
+					return Token(TOK_LESS_THAN_EQUAL, op);
+				}
 				else if(op == "$and") {
 					return Token(TOK_AND, op);
 				}
@@ -116,6 +125,9 @@ Token QueryParser::lex() {
 				else if(op == "$elemMatch") {
 					return Token(TOK_ELEM_MATCH, op);
 				}
+				else if(op == "$size") {
+					return Token(TOK_SIZE, op);
+				}
 				else if(op == "$exists") {
 					return Token(TOK_EXISTS, op);
 				}
@@ -257,21 +269,8 @@ std::shared_ptr<BasicFieldComparison> QueryParser::parse_basic_comparison() {
 				return nullptr;
 			}
 
-			tok = peek();
-			if((tok.token == TOK_STRING_LITERAL) || (tok.token == TOK_NUMERIC_LITERAL)) {
-				tok = lex();
-				auto cmp = make_shared<BasicFieldComparison>();
-				cmp->field_name = field_name;
-				cmp->jp = PointerType(ptr.c_str());
-
-				if(tok.token == TOK_STRING_LITERAL) {
-					cmp->v.type = TYPE_STRING;
-					cmp->v.str = tok.raw;
-				} else {
-					cmp->v.type = TYPE_NUMERIC;
-					cmp->v.numeric = std::stof(tok.raw);
-				}
-
+			std::shared_ptr<BasicFieldComparison> cmp;
+			if(parse_basic_value(field_name, ptr, cmp)) {
 				if(lex().token == TOK_RH_BRACE) {
 					return cmp;
 				}
@@ -282,17 +281,86 @@ std::shared_ptr<BasicFieldComparison> QueryParser::parse_basic_comparison() {
 }
 
 
+/**
+ * Parses the right hand side of a basic comparison, which is a string or number
+ * literal or a ? placeholder. Returns false and consumes nothing if it's 
+ * something else.
+ */
+bool QueryParser::parse_basic_value(const std::string& field_name, const std::string& ptr, 
+		std::shared_ptr<BasicFieldComparison>& cmp) {
+	auto tok = peek();
+	if((tok.token != TOK_STRING_LITERAL) && (tok.token != TOK_NUMERIC_LITERAL) &&
+			(tok.token != TOK_PARAMETER)) {
+		return false;
+	}
+
+	tok = lex();
+	cmp = make_shared<BasicFieldComparison>();
+	cmp->field_name = field_name;
+	cmp->jp = PointerType(ptr.c_str());
+
+	if(tok.token == TOK_STRING_LITERAL) {
+		cmp->v.type = TYPE_STRING;
+		cmp->v.str = tok.raw;
+	} 
+	else if(tok.token == TOK_NUMERIC_LITERAL) {
+		cmp->v.type = TYPE_NUMERIC;
+		cmp->v.numeric = std::stof(tok.raw);
+	}
+	else {
+		// the value is bound later
+		cmp->v.type = TYPE_UNDEFINED;
+		cmp->parameter = n_parameters++;
+	}
+	return true;
+}
+
+// true for the tokens that can start an operator
+static bool is_operator(int token) {
+	switch(token) {
+		case TOK_EQUAL:
+		case TOK_NE:
+		case TOK_GREATER_THAN:
+		case TOK_LESS_THAN:
+		case TOK_GREATER_THAN_EQUAL:
+		case TOK_LESS_THAN_EQUAL:
+		case TOK_STARTS_WITH:
+		case TOK_SIZE:
+		case TOK_REGEX:
+		case TOK_IN:
+		case TOK_NIN:
+		case TOK_EXISTS:
+		case TOK_TYPE:
+		case TOK_ELEM_MATCH:
+			return true;
+	}
+	return false;
+}
+
 /* an expression can have the form
  * { <field_name>: <operator_expression> }
- * { $and/$or: { [ <expression1>, <expression2>,...<expressionN> ] }
+ * { $and/$or/$nor: { [ <expression1>, <expression2>,...<expressionN> ] }
  * { $not: { <expression> }}
+ * { <operator1>, <operator2>,...<operatorN> } inside an $elemMatch
  */
 std::shared_ptr<QueryNode> QueryParser::parse_expression() {
+	if(elem_depth > 0) {
+		// an operator list such as {$gt: 2, $lt: 5} inside an $elemMatch
+		uint32_t tcursor = cursor;
+		lex();
+		auto tok = lex();
+		cursor = tcursor;
+		if(is_operator(tok.token)) {
+			return parse_element_operators();
+		}
+	}
+
 	if(lex().token == TOK_LH_BRACE) {
 		auto tok = lex();
 		// if the token is a field, parse rhs
 		if(tok.token == TOK_FIELD_NAME) {
 			auto f = make_shared<Field>();
+			f->field_name = tok.raw;
 			stringstream ss(tok.raw);
 			string intermediate;
 			string ptr;
@@ -306,20 +374,8 @@ std::shared_ptr<QueryNode> QueryParser::parse_expression() {
 				throw parse_error("Expected a colon after identifier");
 			}
 
-			tok = peek();
-			if((tok.token == TOK_STRING_LITERAL) || (tok.token == TOK_NUMERIC_LITERAL)) {
-				tok = lex();
-				auto cmp = make_shared<BasicFieldComparison>();
-				cmp->jp = PointerType(ptr.c_str());
-
-				if(tok.token == TOK_STRING_LITERAL) {
-					cmp->v.type = TYPE_STRING;
-					cmp->v.str = tok.raw;
-				} else {
-					cmp->v.type = TYPE_NUMERIC;
-					cmp->v.numeric = std::stof(tok.raw);
-				}
-
+			std::shared_ptr<BasicFieldComparison> cmp;
+			if(parse_basic_value(f->field_name, ptr, cmp)) {
 				if(lex().token != TOK_RH_BRACE) {
 					throw parse_error("Missing closing brace after basic field comparison");
 				}
@@ -335,7 +391,7 @@ std::shared_ptr<QueryNode> QueryParser::parse_expression() {
 			}
 			return f;
 		}
-		else if((tok.token == TOK_AND) || (tok.token == TOK_OR)) {
+		else if((tok.token == TOK_AND) || (tok.token == TOK_OR) || (tok.token == TOK_NOR)) {
 			auto a = make_shared<LogicalExpression>();
 			a->op = tok.token;
 
@@ -390,166 +446,200 @@ std::shared_ptr<QueryNode> QueryParser::parse_expression() {
 /**
  * An operator expression can have the form
  * <literal> - this is the same as { $eq: <literal> }
- * { $eq/$ne/$gt/$lt: <literal> }
- * { $in/$nin: <literal_list> }
- * { $exists: true/false }
- * { $type: number/string/bool/array/object }
+ * { <operator> }
  */
 std::shared_ptr<Operator> QueryParser::parse_operator_expression() {
-	auto ret = make_shared<Operator>();
-
 	auto tok = peek();
 	if(tok.token == TOK_LH_BRACE) {
-		tok = lex();
-		tok = lex();
-		if((tok.token == TOK_EQUAL) ||
-				(tok.token == TOK_NE) ||
-				(tok.token == TOK_GREATER_THAN) ||
-				(tok.token == TOK_LESS_THAN) ||
-                (tok.token == TOK_STARTS_WITH)) {
-			ret->op = tok.token;
+		lex();
+		auto ret = parse_operator(lex());
 
-			tok = lex();
-			if(tok.token != TOK_COLON) {
-				throw parse_error("Expected : after " + tok.raw);
-			}
-
-			ret->cmp = parse_literal();
-
-			tok = lex();
-			if(tok.token != TOK_RH_BRACE) {
-				throw parse_error("Missing closing brace 2");
-			}
+		if(lex().token != TOK_RH_BRACE) {
+			throw parse_error("Missing closing brace 2");
 		}
-		else if(tok.token == TOK_REGEX) {
-			ret->op = tok.token;
+		return ret;
+	}
 
-			tok = lex();
-			if(tok.token != TOK_COLON) {
-				throw parse_error("Expected : after " + tok.raw);
-			}
+	auto ret = make_shared<Operator>();
+	ret->op = TOK_EQUAL;
+	ret->cmp = parse_literal();
+	return ret;
+}
 
-			tok = lex();
-			if(tok.token != TOK_STRING_LITERAL) {
-				throw parse_error("Expected string as regex parameter");
-			}
+/**
+ * An operator can have the form
+ * $eq/$ne/$gt/$lt/$gte/$lte/$startsWith/$size: <literal>
+ * $regex: <string_literal>
+ * $in/$nin: <literal_list>
+ * $exists: true/false
+ * $type: number/string/bool/array/object
+ * $elemMatch: <expression>
+ */
+std::shared_ptr<Operator> QueryParser::parse_operator(Token tok) {
+	auto ret = make_shared<Operator>();
 
-			auto rn = make_shared<RegexNode>();
+	if((tok.token == TOK_EQUAL) ||
+			(tok.token == TOK_NE) ||
+			(tok.token == TOK_GREATER_THAN) ||
+			(tok.token == TOK_LESS_THAN) ||
+			(tok.token == TOK_GREATER_THAN_EQUAL) ||
+			(tok.token == TOK_LESS_THAN_EQUAL) ||
+			(tok.token == TOK_STARTS_WITH) ||
+			(tok.token == TOK_SIZE)) {
+		ret->op = tok.token;
 
-			try {
-				if(tok.raw.rfind("(?i)", 0) == 0) {
-					rn->base_regex = std::regex(tok.raw.substr(4, std::string::npos), std::regex_constants::icase);
-				} 
-				else {
-					rn->base_regex = std::regex(tok.raw);
-				}
-			}
-			catch(std::regex_error& err) {
-				std::string errmsg = "Invalid regex: ";
-				errmsg += err.what();
-				throw parse_error(errmsg);
-			}
+		tok = lex();
+		if(tok.token != TOK_COLON) {
+			throw parse_error("Expected : after " + tok.raw);
+		}
 
-			ret->cmp = rn;
+		ret->cmp = parse_literal();
+	}
+	else if(tok.token == TOK_REGEX) {
+		ret->op = tok.token;
 
-			tok = lex();
-			if(tok.token != TOK_RH_BRACE) {
-				throw parse_error("Missing closing brace 2");
-			}
+		tok = lex();
+		if(tok.token != TOK_COLON) {
+			throw parse_error("Expected : after " + tok.raw);
 		}
-		else if((tok.token == TOK_IN) || (tok.token == TOK_NIN)) {
-			ret->op = tok.token;
 
-			tok = lex();
-			if(tok.token != TOK_COLON) {
-				throw parse_error("Expected colon after $in");
-			}
+		tok = lex();
+		if(tok.token != TOK_STRING_LITERAL) {
+			throw parse_error("Expected string as regex parameter");
+		}
 
-			auto l = make_shared<List>();
-			l->list = parse_literal_list();
-			ret->cmp = l;
+		auto rn = make_shared<RegexNode>();
 
-			tok = lex();
-			if(tok.token != TOK_RH_BRACE) {
-				throw parse_error("Missing closing brace");
-			}
+		try {
+			rn->regex = make_shared<const Regex>(tok.raw);
+		}
+		catch(Spino::regex_error& err) {
+			std::string errmsg = "Invalid regex: ";
+			errmsg += err.what();
+			throw parse_error(errmsg);
 		}
-		else if(tok.token == TOK_EXISTS) {
-			ret->op = tok.token;
-			tok = lex();
-			if(tok.token != TOK_COLON) {
-				throw parse_error("Expected colon after $exists");
-			}
 
-			auto b = make_shared<BoolValue>();
-			tok = lex();
-			if(tok.token != TOK_BOOL_LITERAL) {
-				throw parse_error("Expected true/false literal after $exists");
-			}
+		ret->cmp = rn;
+	}
+	else if((tok.token == TOK_IN) || (tok.token == TOK_NIN)) {
+		ret->op = tok.token;
 
-			if(tok.raw == "true") {
-				b->value = true;
-			}
-			else {
-				b->value = false;
-			}
+		tok = lex();
+		if(tok.token != TOK_COLON) {
+			throw parse_error("Expected colon after $in");
+		}
 
-			ret->cmp = b;
+		auto l = make_shared<List>();
+		l->list = parse_literal_list();
+		ret->cmp = l;
+	}
+	else if(tok.token == TOK_ELEM_MATCH) {
+		ret->op = tok.token;
 
-			tok = lex();
-			if(tok.token != TOK_RH_BRACE) {
-				throw parse_error("Missing closing brace");
-			}
+		tok = lex();
+		if(tok.token != TOK_COLON) {
+			throw parse_error("Expected colon after $elemMatch");
 		}
-		else if(tok.token == TOK_TYPE) {
-			ret->op = tok.token;
-			tok = lex();
-			if(tok.token != TOK_COLON) {
-				throw parse_error("Expected colon after $type");
-			}
-
-			tok = lex();
-			if(tok.token != TOK_FIELD_NAME) {
-				throw parse_error("Expected type name after $type");
-			}
 
-			std::set<std::string> type_names = {
-				"number",
-				"string",
-				"bool",
-				"array",
-				"object"
-			};
-
-			if(type_names.find(tok.raw) != type_names.end()) {
-				auto b = make_shared<StringValue>();
-				b->value = tok.raw;
-				ret->cmp = b;
-			}
-			else {
-				throw parse_error("Invalid type name");	
-			}
+		// elements that are objects are matched with an expression, such 
+		// as {$elemMatch: {name: "Earth"}}, and other elements with a list 
+		// of operators, such as {$elemMatch: {$gt: 2, $lt: 5}}
+		elem_depth++;
+		ret->cmp = parse_expression();
+		elem_depth--;
+	}
+	else if(tok.token == TOK_EXISTS) {
+		ret->op = tok.token;
+		tok = lex();
+		if(tok.token != TOK_COLON) {
+			throw parse_error("Expected colon after $exists");
+		}
 
-			tok = lex();
-			if(tok.token != TOK_RH_BRACE) {
-				throw parse_error("Missing closing brace");
-			}
+		auto b = make_shared<BoolValue>();
+		tok = lex();
+		if(tok.token != TOK_BOOL_LITERAL) {
+			throw parse_error("Expected true/false literal after $exists");
+		}
 
+		if(tok.raw == "true") {
+			b->value = true;
 		}
 		else {
-			throw parse_error("Expected a $ operator");
+			b->value = false;
 		}
 
+		ret->cmp = b;
+	}
+	else if(tok.token == TOK_TYPE) {
+		ret->op = tok.token;
+		tok = lex();
+		if(tok.token != TOK_COLON) {
+			throw parse_error("Expected colon after $type");
+		}
+
+		tok = lex();
+		if(tok.token != TOK_FIELD_NAME) {
+			throw parse_error("Expected type name after $type");
+		}
+
+		std::set<std::string> type_names = {
+			"number",
+			"string",
+			"bool",
+			"array",
+			"object"
+		};
+
+		if(type_names.find(tok.raw) != type_names.end()) {
+			auto b = make_shared<StringValue>();
+			b->value = tok.raw;
+			ret->cmp = b;
+		}
+		else {
+			throw parse_error("Invalid type name");	
+		}
 	}
 	else {
-		ret->op = TOK_EQUAL;
-		ret->cmp = parse_literal();
+		throw parse_error("Expected a $ operator");
 	}
 	return ret;
 }
 
 /**
- * Parses a literal value such as a string, number or true/false
+ * Inside an $elemMatch, an expression can be a list of operators that
+ * the element itself must match
+ * { <operator1>, <operator2>,...<operatorN> }
+ */
+std::shared_ptr<QueryNode> QueryParser::parse_element_operators() {
+	if(lex().token != TOK_LH_BRACE) {
+		throw parse_error("Missing opening brace");
+	}
+
+	auto a = make_shared<LogicalExpression>();
+	a->op = TOK_AND;
+	Token tok(TOK_COMMA, ",");
+	do {
+		// an empty pointer refers to the element
+		auto f = make_shared<Field>();
+		f->jp = PointerType("");
+		f->operation = parse_operator(lex());
+		a->fields.push_back(f);
+
+		tok = lex();
+		if((tok.token != TOK_RH_BRACE) && (tok.token != TOK_COMMA)) {
+			throw parse_error("Unexpected token in operator list");
+		}
+	} while(tok.token != TOK_RH_BRACE);
+
+	if(a->fields.size() == 1) {
+		return a->fields[0];
+	}
+	return a;
+}
+
+/**
+ * Parses a literal value such as a string, number or true/false, or a ? 
+ * placeholder for a value that is bound later
  */
 std::shared_ptr<QueryNode> QueryParser::parse_literal() {
 	auto tok = lex();
@@ -573,6 +663,12 @@ std::shared_ptr<QueryNode> QueryParser::parse_literal() {
 		}
 		return r;
 	}
+	else if(tok.token == TOK_PARAMETER) {
+		auto r = make_shared<Parameter>();
+		r->index = n_parameters++;
+		r->value.type = TYPE_UNDEFINED;
+		return r;
+	}
 	throw parse_error("Expected either a comparison operator or a literal value");
 }
 
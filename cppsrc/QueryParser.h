@@ -69,6 +69,8 @@ enum TOKEN {
 	TOK_NE,
 	TOK_GREATER_THAN,
 	TOK_LESS_THAN,
+	TOK_GREATER_THAN_EQUAL,
+	TOK_LESS_THAN_EQUAL,
 	TOK_STARTS_WITH,
 	TOK_REGEX,
 	TOK_FIELD_NAME,
@@ -79,7 +81,9 @@ enum TOKEN {
 	TOK_COMMA,
 	TOK_EXISTS,
 	TOK_ELEM_MATCH,
+	TOK_SIZE,
 	TOK_TYPE,
+	TOK_PARAMETER,
 	TOK_EOF
 };
 
@@ -106,9 +110,17 @@ class QueryParser {
 
 		std::shared_ptr<BasicFieldComparison> parse_basic_comparison();
 		std::shared_ptr<QueryNode> parse_expression();
+
+		// the number of ? placeholders that have been parsed
+		uint32_t parameter_count() const { return n_parameters; }
 	private:
 		const char* query_string;
 		uint32_t cursor = 0;
+		uint32_t n_parameters = 0;
+
+		// how many $elemMatch expressions are being parsed. inside one, 
+		// an expression can be a list of operators on the element itself
+		uint32_t elem_depth = 0;
 
 		inline char curc() const {
 			return query_string[cursor];
@@ -125,7 +137,11 @@ class QueryParser {
 		Token lex();
 
 		std::shared_ptr<Operator> parse_operator_expression();
+		std::shared_ptr<Operator> parse_operator(Token tok);
+		std::shared_ptr<QueryNode> parse_element_operators();
 		std::shared_ptr<QueryNode> parse_literal();
+		bool parse_basic_value(const std::string& field_name, const std::string& ptr, 
+				std::shared_ptr<BasicFieldComparison>& cmp);
 		std::vector<std::shared_ptr<QueryNode>> parse_literal_list();
 };
 
@@ -0,0 +1,513 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+
+#include "QueryPlanner.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Spino {
+
+    QueryPlanner::QueryPlanner(const Collection& collection) : collection(collection) { }
+
+    bool QueryPlanner::plan(std::shared_ptr<QueryNode> head, std::vector<uint32_t>& candidates) {
+        double rows = estimate(head);
+        if(rows < 0) {
+            return false;
+        }
+
+        // fetching a candidate costs a lot more than visiting a document 
+        // during a linear scan, so indices are only worth it if they 
+        // rule out most of the collection
+        if(rows > collection.size() / 4.0) {
+            return false;
+        }
+
+        fetch(head, candidates);
+        return true;
+    }
+
+    void QueryPlanner::use(const Collection::Index* idx) {
+        if(std::find(used.begin(), used.end(), idx->field_name) == used.end()) {
+            used.push_back(idx->field_name);
+        }
+    }
+
+    const Collection::Index* QueryPlanner::keyRange(CompoundIteratorRange& range) const {
+        if(key_index == nullptr) {
+            return nullptr;
+        }
+        range = key_range;
+        return key_index;
+    }
+
+    bool QueryPlanner::getClause(std::shared_ptr<QueryNode> node, Clause& clause) {
+        if(auto bfc = std::dynamic_pointer_cast<BasicFieldComparison>(node)) {
+            clause.field_name = bfc->field_name;
+            clause.op = TOK_EQUAL;
+            clause.v = bfc->v;
+            return (clause.v.type == TYPE_NUMERIC) || (clause.v.type == TYPE_STRING);
+        }
+
+        auto field = std::dynamic_pointer_cast<Field>(node);
+        if((field == nullptr) || (field->operation == nullptr)) {
+            return false;
+        }
+
+        auto op = field->operation->op;
+        if(op == TOK_REGEX) {
+            // every match starts with the literal prefix of the pattern, 
+            // so it can be looked up as a range of an ordered index
+            auto rn = std::dynamic_pointer_cast<RegexNode>(field->operation->cmp);
+            if((rn == nullptr) || rn->regex->prefix().empty()) {
+                return false;
+            }
+            clause.field_name = field->field_name;
+            clause.op = TOK_STARTS_WITH;
+            clause.v.type = TYPE_STRING;
+            clause.v.str = rn->regex->prefix();
+            return true;
+        }
+
+        if(op == TOK_IN) {
+            // every value in the list must be something the index can find
+            auto list = std::dynamic_pointer_cast<List>(field->operation->cmp);
+            if((list == nullptr) || list->list.empty()) {
+                return false;
+            }
+            clause.values.clear();
+            for(auto& item : list->list) {
+                Value v;
+                if(!literalValue(item, v) || ((v.type != TYPE_NUMERIC) && (v.type != TYPE_STRING))) {
+                    return false;
+                }
+                clause.values.push_back(v);
+            }
+            clause.field_name = field->field_name;
+            clause.op = TOK_IN;
+            return true;
+        }
+
+        if((op != TOK_EQUAL) && (op != TOK_GREATER_THAN) && (op != TOK_LESS_THAN) &&
+                (op != TOK_GREATER_THAN_EQUAL) && (op != TOK_LESS_THAN_EQUAL) &&
+                (op != TOK_STARTS_WITH)) {
+            return false;
+        }
+
+        if(!literalValue(field->operation->cmp, clause.v) ||
+                ((clause.v.type != TYPE_NUMERIC) && (clause.v.type != TYPE_STRING)) ||
+                ((op == TOK_STARTS_WITH) && (clause.v.type != TYPE_STRING))) {
+            return false;
+        }
+
+        clause.field_name = field->field_name;
+        clause.op = op;
+        return true;
+    }
+
+    double QueryPlanner::estimate(std::shared_ptr<QueryNode> node) {
+        Clause clause;
+        if(getClause(node, clause)) {
+            double rows = clauseEstimate(clause);
+
+            std::vector<Clause> clauses = {clause};
+            CompoundPlan cp;
+            planCompound(clauses, cp);
+            if((cp.rows >= 0) && ((rows < 0) || (cp.rows < rows))) {
+                rows = cp.rows;
+            }
+            return rows;
+        }
+
+        // the documents a $nor matches aren't in any index range
+        auto l = std::dynamic_pointer_cast<LogicalExpression>(node);
+        if((l == nullptr) || (l->op == TOK_NOR)) {
+            return -1;
+        }
+
+        if(l->op == TOK_AND) {
+            // an $and can't match more documents than its most selective clause
+            double rows = -1;
+            std::vector<Clause> clauses;
+            for(auto& child : l->fields) {
+                double e = estimate(child);
+                if((e >= 0) && ((rows < 0) || (e < rows))) {
+                    rows = e;
+                }
+                if(getClause(child, clause)) {
+                    clauses.push_back(clause);
+                }
+            }
+
+            CompoundPlan cp;
+            planCompound(clauses, cp);
+            if((cp.rows >= 0) && ((rows < 0) || (cp.rows < rows))) {
+                rows = cp.rows;
+            }
+            return rows;
+        }
+        else {
+            // an $or needs an index for every clause
+            double rows = 0;
+            for(auto& child : l->fields) {
+                double e = estimate(child);
+                if(e < 0) {
+                    return -1;
+                }
+                rows += e;
+            }
+            return rows;
+        }
+    }
+
+    void QueryPlanner::fetch(std::shared_ptr<QueryNode> node, std::vector<uint32_t>& slots) {
+        Clause clause;
+        if(getClause(node, clause)) {
+            double rows = clauseEstimate(clause);
+
+            std::vector<Clause> clauses = {clause};
+            CompoundPlan cp;
+            planCompound(clauses, cp);
+            if((cp.rows >= 0) && ((rows < 0) || (cp.rows < rows))) {
+                fetchCompound(cp, slots);
+            }
+            else {
+                fetchClause(clause, slots);
+            }
+            return;
+        }
+
+        auto l = std::dynamic_pointer_cast<LogicalExpression>(node);
+        if(l == nullptr) {
+            return;
+        }
+
+        if(l->op == TOK_AND) {
+            std::vector<std::pair<double, std::shared_ptr<QueryNode>>> indexed;
+            std::vector<Clause> clauses;
+            for(auto& child : l->fields) {
+                double e = estimate(child);
+                if(e >= 0) {
+                    indexed.push_back({e, child});
+                }
+                if(getClause(child, clause)) {
+                    clauses.push_back(clause);
+                }
+            }
+            std::stable_sort(indexed.begin(), indexed.end(), 
+                    [](const std::pair<double, std::shared_ptr<QueryNode>>& a, 
+                        const std::pair<double, std::shared_ptr<QueryNode>>& b) {
+                        return a.first < b.first;
+                    });
+
+            CompoundPlan cp;
+            planCompound(clauses, cp);
+
+            size_t next = 0;
+            if((cp.rows >= 0) && (indexed.empty() || (cp.rows < indexed[0].first))) {
+                fetchCompound(cp, slots);
+            }
+            else if(indexed.size()) {
+                fetch(indexed[0].second, slots);
+                next = 1;
+            }
+
+            // intersecting with the candidates of other clauses is worth it 
+            // while their lists aren't much longer than the current one
+            const uint32_t max_lists = 3;
+            for(uint32_t n = 1; (next < indexed.size()) && (n < max_lists); next++, n++) {
+                if(slots.empty() || (indexed[next].first > slots.size()*8.0)) {
+                    break;
+                }
+                std::vector<uint32_t> other;
+                fetch(indexed[next].second, other);
+
+                std::vector<uint32_t> both;
+                std::set_intersection(slots.begin(), slots.end(), 
+                        other.begin(), other.end(), std::back_inserter(both));
+                slots.swap(both);
+            }
+        }
+        else {
+            // a union isn't inside any one range
+            first_list = false;
+            for(auto& child : l->fields) {
+                std::vector<uint32_t> other;
+                fetch(child, other);
+
+                std::vector<uint32_t> either;
+                std::set_union(slots.begin(), slots.end(), 
+                        other.begin(), other.end(), std::back_inserter(either));
+                slots.swap(either);
+            }
+        }
+    }
+
+    const Collection::Index* QueryPlanner::clauseIndex(const Clause& clause) const {
+        // hash indices are preferred for equality
+        const Collection::Index* ret = nullptr;
+        for(auto idx : collection.indices) {
+            if(idx->compound || (idx->field_name != clause.field_name)) {
+                continue;
+            }
+            if(idx->kind == INDEX_HASH) {
+                if((clause.op == TOK_EQUAL) || (clause.op == TOK_IN)) {
+                    return idx;
+                }
+            }
+            else if(ret == nullptr) {
+                ret = idx;
+            }
+        }
+        return ret;
+    }
+
+    double QueryPlanner::clauseEstimate(const Clause& clause) const {
+        auto idx = clauseIndex(clause);
+        if(idx == nullptr) {
+            return -1;
+        }
+
+        if(clause.op == TOK_IN) {
+            // each value is a separate lookup
+            Clause eq;
+            eq.field_name = clause.field_name;
+            eq.op = TOK_EQUAL;
+            double rows = 0;
+            for(auto& v : clause.values) {
+                eq.v = v;
+                rows += clauseEstimate(eq);
+            }
+            return rows;
+        }
+
+        double entries = (idx->kind == INDEX_HASH) ? idx->hash.size() : idx->index.size();
+#ifdef SPINO_COUNTED_INDEX
+        // ordered indices know the size of any range
+        if(idx->kind != INDEX_HASH) {
+            IndexIteratorRange range;
+            clauseRange(*idx, clause, range);
+            return rangeSize(idx->index, range);
+        }
+#endif
+        if(clause.op == TOK_EQUAL) {
+            return entries / std::max(idx->distinct, 1u);
+        }
+        if(clause.op == TOK_STARTS_WITH) {
+            // prefixes are often selective, so count the range until it's
+            // clearly too big to be worth using
+            IndexIteratorRange range;
+            collection.orderedRange(*idx, clause.op, clause.v, range);
+            double limit = collection.size() / 4.0;
+            double rows = 0;
+            for(auto iter = range.first; (iter != range.second) && (rows <= limit); iter++) {
+                rows++;
+            }
+            return rows;
+        }
+        // there are no statistics for ranges. assume a third of the entries. 
+        return entries / 3.0;
+    }
+
+    void QueryPlanner::fetchClause(const Clause& clause, std::vector<uint32_t>& slots) {
+        first_list = false;
+        auto idx = clauseIndex(clause);
+        if(idx == nullptr) {
+            return;
+        }
+        use(idx);
+
+        if(clause.op == TOK_IN) {
+            // seek to each value and merge the slots. a document can only
+            // be found once per value, but duplicate values in the list
+            // would find it twice.
+            for(auto& v : clause.values) {
+                if(idx->kind == INDEX_HASH) {
+                    std::vector<uint32_t> matched;
+                    collection.hashLookup(*idx, v, matched);
+                    slots.insert(slots.end(), matched.begin(), matched.end());
+                }
+                else {
+                    auto begin = idx->index.lower_bound({v, 0});
+                    auto end = idx->index.upper_bound({v, UINT32_MAX});
+                    for(auto iter = begin; iter != end; iter++) {
+                        slots.push_back(iter->second);
+                    }
+                }
+            }
+            std::sort(slots.begin(), slots.end());
+            slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+            return;
+        }
+
+        if(idx->kind == INDEX_HASH) {
+            collection.hashLookup(*idx, clause.v, slots);
+            return;
+        }
+
+        IndexIteratorRange range;
+        clauseRange(*idx, clause, range);
+        for(auto iter = range.first; iter != range.second; iter++) {
+            slots.push_back(iter->second);
+        }
+        std::sort(slots.begin(), slots.end());
+        if(idx->multikey) {
+            // different elements of an array can be in the same range
+            slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+        }
+    }
+
+    void QueryPlanner::clauseRange(const Collection::Index& idx, const Clause& clause, 
+            IndexIteratorRange& range) const {
+        if(clause.op == TOK_EQUAL) {
+            range.first = idx.index.lower_bound({clause.v, 0});
+            range.second = idx.index.upper_bound({clause.v, UINT32_MAX});
+        }
+        else {
+            collection.orderedRange(idx, clause.op, clause.v, range);
+        }
+    }
+
+    void QueryPlanner::planCompound(const std::vector<Clause>& clauses, CompoundPlan& plan) const {
+        for(auto idx : collection.indices) {
+            if(!idx->compound || idx->multikey) {
+                continue;
+            }
+
+            // find the longest prefix of fields that are compared for 
+            // equality, and any range on the field after it
+            std::vector<Value> prefix;
+            const Clause* lower = nullptr;
+            const Clause* upper = nullptr;
+            for(auto& name : idx->field_names) {
+                const Clause* eq = nullptr;
+                lower = upper = nullptr;
+                for(auto& c : clauses) {
+                    if(c.field_name != name) {
+                        continue;
+                    }
+                    if(c.op == TOK_EQUAL) {
+                        eq = &c;
+                    }
+                    else if((c.op == TOK_GREATER_THAN) || (c.op == TOK_GREATER_THAN_EQUAL)) {
+                        lower = &c;
+                    }
+                    else if((c.op == TOK_LESS_THAN) || (c.op == TOK_LESS_THAN_EQUAL)) {
+                        upper = &c;
+                    }
+                }
+                if(eq == nullptr) {
+                    break;
+                }
+                prefix.push_back(eq->v);
+            }
+            if(prefix.size() == idx->field_names.size()) {
+                lower = upper = nullptr;
+            }
+            if(lower && upper && (lower->v.type != upper->v.type)) {
+                upper = nullptr;
+            }
+            if(prefix.empty() && !lower && !upper) {
+                continue;
+            }
+
+            // assume the fields are independent, so each field in the 
+            // prefix divides the entries by the same amount
+            double entries = idx->compound_index.size();
+            double k = idx->field_names.size();
+            double rows = entries / pow(std::max(idx->distinct, 1u), prefix.size() / k);
+            if(lower || upper) {
+                rows /= 3.0;
+            }
+
+            if((plan.rows < 0) || (rows < plan.rows)) {
+                plan.idx = idx;
+                plan.prefix = prefix;
+                plan.lower = lower;
+                plan.upper = upper;
+                plan.rows = rows;
+            }
+        }
+    }
+
+    void QueryPlanner::fetchCompound(const CompoundPlan& plan, std::vector<uint32_t>& slots) {
+        use(plan.idx);
+
+        // a value that sorts after every other value
+        Value last;
+        last.type = UINT32_MAX;
+
+        std::vector<Value> from = plan.prefix;
+        std::vector<Value> to = plan.prefix;
+        if(plan.lower || plan.upper) {
+            // values of other types never match a range comparison
+            uint32_t type = plan.lower ? plan.lower->v.type : plan.upper->v.type;
+            Value type_first;
+            type_first.type = type;
+            type_first.numeric = -INFINITY;
+            Value type_end;
+            type_end.type = type + 1;
+            type_end.numeric = -INFINITY;
+
+            if(plan.lower) {
+                from.push_back(plan.lower->v);
+                if(plan.lower->op == TOK_GREATER_THAN) {
+                    from.push_back(last);
+                }
+            }
+            else {
+                from.push_back(type_first);
+            }
+
+            if(plan.upper) {
+                to.push_back(plan.upper->v);
+                if(plan.upper->op == TOK_LESS_THAN_EQUAL) {
+                    to.push_back(last);
+                }
+            }
+            else {
+                to.push_back(type_end);
+            }
+        }
+        else {
+            to.push_back(last);
+        }
+
+        auto& index = plan.idx->compound_index;
+        if(index.value_comp()({to, 0}, {from, 0})) {
+            first_list = false;
+            return; // empty range
+        }
+
+        auto begin = index.lower_bound({from, 0});
+        auto end = index.lower_bound({to, 0});
+        for(auto iter = begin; iter != end; iter++) {
+            slots.push_back(iter->second);
+        }
+        if(first_list) {
+            key_index = plan.idx;
+            key_range = {begin, end};
+        }
+        first_list = false;
+        std::sort(slots.begin(), slots.end());
+    }
+}
+
@@ -0,0 +1,98 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+#ifndef SPINO_QUERY_PLANNER_H
+#define SPINO_QUERY_PLANNER_H
+
+#include "Collection.h"
+
+namespace Spino {
+
+    // the planner looks for indices that can narrow down a query. it estimates
+    // how many documents each indexed clause will match from the index 
+    // statistics and fetches candidates from the most selective indices.
+    // candidates are a superset of the results, so the query must still
+    // be checked against each one.
+    class QueryPlanner {
+        public:
+            QueryPlanner(const Collection& collection);
+
+            // gets the slots of the candidate documents in ascending order.
+            // returns false if a linear scan is the better plan.
+            bool plan(std::shared_ptr<QueryNode> head, std::vector<uint32_t>& candidates);
+
+            // if the candidates were narrowed down from one range of a 
+            // compound index, gets the index and the range. every result 
+            // is in the range, so its keys can be read instead of the 
+            // documents.
+            const Collection::Index* keyRange(CompoundIteratorRange& range) const;
+
+            // the names of the indices the candidates were found with
+            const std::vector<std::string>& indicesUsed() const { return used; }
+
+        private:
+            // a comparison of a field to a literal value. an $in clause 
+            // has a list of values that are each looked up for equality.
+            struct Clause {
+                std::string field_name;
+                int op;
+                Value v;
+                std::vector<Value> values;
+            };
+
+            // the best way to use a compound index for a set of clauses
+            struct CompoundPlan {
+                const Collection::Index* idx = nullptr;
+                std::vector<Value> prefix;
+                const Clause* lower = nullptr;
+                const Clause* upper = nullptr;
+                double rows = -1;
+            };
+
+            static bool getClause(std::shared_ptr<QueryNode> node, Clause& clause);
+
+            // estimated number of candidates, or less than 0 if the node
+            // can't use an index
+            double estimate(std::shared_ptr<QueryNode> node);
+            void fetch(std::shared_ptr<QueryNode> node, std::vector<uint32_t>& slots);
+
+            const Collection::Index* clauseIndex(const Clause& clause) const;
+            double clauseEstimate(const Clause& clause) const;
+            void fetchClause(const Clause& clause, std::vector<uint32_t>& slots);
+            void clauseRange(const Collection::Index& idx, const Clause& clause, 
+                    IndexIteratorRange& range) const;
+
+            void planCompound(const std::vector<Clause>& clauses, CompoundPlan& plan) const;
+            void fetchCompound(const CompoundPlan& plan, std::vector<uint32_t>& slots);
+
+            const Collection& collection;
+
+            std::vector<std::string> used;
+            void use(const Collection::Index* idx);
+
+            // the key range is noted until something other than the first
+            // list of candidates is fetched
+            bool first_list = true;
+            const Collection::Index* key_index = nullptr;
+            CompoundIteratorRange key_range;
+    };
+}
+
+#endif
@@ -0,0 +1,486 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+
+#include "QueryProgram.h"
+#include "QueryParser.h"
+#include "HashIndex.h"
+
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+
+namespace Spino {
+
+    QueryProgram::QueryProgram(std::shared_ptr<QueryNode> head) {
+        compile(head);
+    }
+
+    void QueryProgram::compile(std::shared_ptr<QueryNode> head) {
+        code.clear();
+        fields.clear();
+        literals.clear();
+        regexes.clear();
+        sets.clear();
+        elements.clear();
+        parameters.clear();
+        if(head) {
+            compileNode(head);
+        }
+        bound = checkBound();
+    }
+
+    bool QueryProgram::checkBound() const {
+        for(auto p : parameters) {
+            if((p != UINT32_MAX) && (literals[p].type == TYPE_UNDEFINED)) {
+                return false;
+            }
+        }
+        for(auto& element : elements) {
+            if(!element->allBound()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint32_t QueryProgram::addField(const PointerType& jp) {
+        for(size_t i = 0; i < fields.size(); i++) {
+            if(fields[i] == jp) {
+                return i;
+            }
+        }
+        fields.push_back(jp);
+        return fields.size() - 1;
+    }
+
+    bool QueryProgram::readsOnly(const std::vector<PointerType>& only) const {
+        for(auto& field : fields) {
+            if(std::find(only.begin(), only.end(), field) == only.end()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint32_t QueryProgram::addLiteral(std::shared_ptr<QueryNode> node) {
+        Value v;
+        if(!literalValue(node, v)) {
+            throw parse_error("Expected a literal value");
+        }
+        literals.push_back(v);
+        if(auto p = std::dynamic_pointer_cast<Parameter>(node)) {
+            addParameter(p->index, literals.size() - 1);
+        }
+        return literals.size() - 1;
+    }
+
+    void QueryProgram::addParameter(uint32_t index, uint32_t literal) {
+        if(index >= parameters.size()) {
+            parameters.resize(index + 1, UINT32_MAX);
+        }
+        parameters[index] = literal;
+    }
+
+    void QueryProgram::bind(uint32_t index, const Value& v) {
+        if((index < parameters.size()) && (parameters[index] != UINT32_MAX)) {
+            uint32_t literal = parameters[index];
+            literals[literal] = v;
+            for(auto& set : sets) {
+                if((literal >= set.first) && (literal < set.first + set.count)) {
+                    buildSet(set);
+                }
+            }
+        }
+
+        // placeholders are numbered across the whole query
+        for(auto& element : elements) {
+            element->bind(index, v);
+        }
+        bound = checkBound();
+    }
+
+    void QueryProgram::buildSet(LiteralSet& set) {
+        set.numbers.clear();
+        set.has_true = set.has_false = false;
+        uint32_t n_strings = 0;
+        for(uint32_t i = set.first; i < set.first + set.count; i++) {
+            const Value& lit = literals[i];
+            if(lit.type == TYPE_NUMERIC) {
+                set.numbers.push_back(lit.numeric);
+            }
+            else if(lit.type == TYPE_STRING) {
+                n_strings++;
+            }
+            else if(lit.type == TYPE_BOOLEAN) {
+                (lit.boolean ? set.has_true : set.has_false) = true;
+            }
+        }
+        std::sort(set.numbers.begin(), set.numbers.end());
+
+        // open addressing with at most half of the table in use. 
+        // 0 is an empty bucket, otherwise it's the literal index + 1.
+        set.strings.clear();
+        if(n_strings == 0) {
+            return;
+        }
+        uint32_t size = 4;
+        while(size < n_strings * 2) {
+            size *= 2;
+        }
+        set.strings.resize(size, 0);
+        for(uint32_t i = set.first; i < set.first + set.count; i++) {
+            const Value& lit = literals[i];
+            if(lit.type != TYPE_STRING) {
+                continue;
+            }
+            uint32_t b = HashIndex::hashString(lit.str.data(), lit.str.size()) & (size - 1);
+            while(set.strings[b] != 0) {
+                b = (b + 1) & (size - 1);
+            }
+            set.strings[b] = i + 1;
+        }
+    }
+
+    bool QueryProgram::inSet(const ValueType* v, const LiteralSet& set) const {
+        if(v == nullptr) {
+            return false;
+        }
+        if(v->IsString()) {
+            if(set.strings.empty()) {
+                return false;
+            }
+            uint32_t mask = set.strings.size() - 1;
+            const char* s = v->GetString();
+            size_t len = v->GetStringLength();
+            uint32_t b = HashIndex::hashString(s, len) & mask;
+            while(set.strings[b] != 0) {
+                const Value& lit = literals[set.strings[b] - 1];
+                if((lit.str.size() == len) && (memcmp(lit.str.data(), s, len) == 0)) {
+                    return true;
+                }
+                b = (b + 1) & mask;
+            }
+            return false;
+        }
+        if(v->IsNumber()) {
+            // the first number that could be close enough
+            double d = v->GetDouble();
+            auto it = std::lower_bound(set.numbers.begin(), set.numbers.end(), d - 0.000001);
+            return (it != set.numbers.end()) && (fabs(*it - d) < 0.000001);
+        }
+        if(v->IsBool()) {
+            return v->GetBool() ? set.has_true : set.has_false;
+        }
+        return false;
+    }
+
+    void QueryProgram::compileNode(std::shared_ptr<QueryNode> node) {
+        if(auto bfc = std::dynamic_pointer_cast<BasicFieldComparison>(node)) {
+            literals.push_back(bfc->v);
+            if(bfc->parameter >= 0) {
+                addParameter(bfc->parameter, literals.size() - 1);
+            }
+            code.push_back({OP_EQ, addField(bfc->jp), (uint32_t)literals.size()-1, 0});
+        }
+        else if(auto f = std::dynamic_pointer_cast<Field>(node)) {
+            compileOperator(f->jp, f->operation);
+        }
+        else if(auto l = std::dynamic_pointer_cast<LogicalExpression>(node)) {
+            // a false result ends an $and early and a true result ends an 
+            // $or. a $nor is an $or with the result inverted.
+            uint32_t jump = (l->op == TOK_AND) ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE;
+            std::vector<size_t> jumps;
+            for(size_t i = 0; i < l->fields.size(); i++) {
+                compileNode(l->fields[i]);
+                if(i+1 < l->fields.size()) {
+                    jumps.push_back(code.size());
+                    code.push_back({jump, 0, 0, 0});
+                }
+            }
+            for(auto j : jumps) {
+                code[j].arg = code.size();
+            }
+            if(l->op == TOK_NOR) {
+                code.push_back({OP_NOT, 0, 0, 0});
+            }
+        }
+        else if(auto op = std::dynamic_pointer_cast<Operator>(node)) {
+            if(op->op != TOK_NOT) {
+                throw parse_error("Unexpected operator");
+            }
+            compileNode(op->cmp);
+            code.push_back({OP_NOT, 0, 0, 0});
+        }
+        else {
+            throw parse_error("Unexpected query node");
+        }
+    }
+
+    void QueryProgram::compileOperator(const PointerType& jp, std::shared_ptr<Operator> op) {
+        Instruction ins = {0, addField(jp), 0, 0};
+        switch(op->op) {
+            case TOK_EQUAL: ins.opcode = OP_EQ; break;
+            case TOK_NE: ins.opcode = OP_NE; break;
+            case TOK_GREATER_THAN: ins.opcode = OP_GT; break;
+            case TOK_LESS_THAN: ins.opcode = OP_LT; break;
+            case TOK_GREATER_THAN_EQUAL: ins.opcode = OP_GTE; break;
+            case TOK_LESS_THAN_EQUAL: ins.opcode = OP_LTE; break;
+            case TOK_STARTS_WITH: ins.opcode = OP_STARTS_WITH; break;
+            case TOK_IN: ins.opcode = OP_IN; break;
+            case TOK_NIN: ins.opcode = OP_NIN; break;
+            case TOK_EXISTS: ins.opcode = OP_EXISTS; break;
+            case TOK_TYPE: ins.opcode = OP_TYPE; break;
+            case TOK_REGEX: ins.opcode = OP_REGEX; break;
+            case TOK_SIZE: ins.opcode = OP_SIZE; break;
+            case TOK_ELEM_MATCH: ins.opcode = OP_ELEM_MATCH; break;
+            default:
+                throw parse_error("Unexpected operator");
+        }
+
+        if((ins.opcode == OP_IN) || (ins.opcode == OP_NIN)) {
+            auto list = std::dynamic_pointer_cast<List>(op->cmp);
+            LiteralSet set;
+            set.first = literals.size();
+            for(auto& item : list->list) {
+                addLiteral(item);
+            }
+            set.count = list->list.size();
+            buildSet(set);
+            sets.push_back(std::move(set));
+            ins.arg = sets.size() - 1;
+            ins.count = list->list.size();
+        }
+        else if(ins.opcode == OP_TYPE) {
+            auto name = std::dynamic_pointer_cast<StringValue>(op->cmp)->value;
+            if(name == "string") {
+                ins.arg = TYPE_STRING;
+            }
+            else if(name == "number") {
+                ins.arg = TYPE_NUMERIC;
+            }
+            else if(name == "bool") {
+                ins.arg = TYPE_BOOLEAN;
+            }
+            else if(name == "array") {
+                ins.arg = TYPE_ARRAY;
+            }
+            else if(name == "object") {
+                ins.arg = TYPE_OBJECT;
+            }
+            else {
+                ins.arg = TYPE_UNDEFINED;
+            }
+        }
+        else if(ins.opcode == OP_REGEX) {
+            regexes.push_back(std::dynamic_pointer_cast<RegexNode>(op->cmp)->regex);
+            ins.arg = regexes.size() - 1;
+        }
+        else if(ins.opcode == OP_ELEM_MATCH) {
+            // operators on the element itself compare an empty pointer,
+            // which refers to the element
+            auto element = std::make_shared<QueryProgram>(op->cmp);
+            elements.push_back(element);
+            ins.arg = elements.size() - 1;
+        }
+        else {
+            ins.arg = addLiteral(op->cmp);
+        }
+        code.push_back(ins);
+    }
+
+    bool QueryProgram::matches(const ValueType& doc) const {
+        if(!bound) {
+            return false;
+        }
+
+        // an empty query matches everything
+        bool r = true;
+        size_t pc = 0;
+        size_t n = code.size();
+        while(pc < n) {
+            const Instruction& ins = code[pc++];
+            switch(ins.opcode) {
+                case OP_JUMP_IF_FALSE:
+                    if(!r) {
+                        pc = ins.arg;
+                    }
+                    break;
+                case OP_JUMP_IF_TRUE:
+                    if(r) {
+                        pc = ins.arg;
+                    }
+                    break;
+                case OP_NOT:
+                    r = !r;
+                    break;
+                default:
+                    {
+                        const ValueType* v = fields[ins.field].Get(doc);
+                        if(v && v->IsArray()) {
+                            r = executeArray(ins, *v);
+                        }
+                        else {
+                            r = execute(ins, v);
+                        }
+                    }
+                    break;
+            }
+        }
+        return r;
+    }
+
+    bool QueryProgram::equals(const ValueType* v, const Value& literal) const {
+        if(v == nullptr) {
+            return false;
+        }
+        switch(literal.type) {
+            case TYPE_NUMERIC:
+                return v->IsNumber() && (fabs(v->GetDouble() - literal.numeric) < 0.000001);
+            case TYPE_STRING:
+                return v->IsString() && 
+                    (v->GetStringLength() == literal.str.size()) &&
+                    (memcmp(v->GetString(), literal.str.data(), literal.str.size()) == 0);
+            case TYPE_BOOLEAN:
+                return v->IsBool() && (v->GetBool() == literal.boolean);
+        }
+        return false;
+    }
+
+    // numbers are compared with numbers and strings with strings
+    int QueryProgram::compare(const ValueType* v, const Value& literal, bool& comparable) const {
+        comparable = false;
+        if(v == nullptr) {
+            return 0;
+        }
+        if(v->IsNumber() && (literal.type == TYPE_NUMERIC)) {
+            comparable = true;
+            double d = v->GetDouble();
+            return (d < literal.numeric) ? -1 : ((d > literal.numeric) ? 1 : 0);
+        }
+        if(v->IsString() && (literal.type == TYPE_STRING)) {
+            comparable = true;
+            size_t len = v->GetStringLength();
+            size_t n = std::min(len, literal.str.size());
+            int cmp = memcmp(v->GetString(), literal.str.data(), n);
+            if(cmp != 0) {
+                return cmp;
+            }
+            return (len < literal.str.size()) ? -1 : ((len > literal.str.size()) ? 1 : 0);
+        }
+        return 0;
+    }
+
+    bool QueryProgram::execute(const Instruction& ins, const ValueType* v) const {
+        switch(ins.opcode) {
+            case OP_EQ:
+                return equals(v, literals[ins.arg]);
+            case OP_NE:
+                return !equals(v, literals[ins.arg]);
+            case OP_GT:
+            case OP_LT:
+            case OP_GTE:
+            case OP_LTE:
+                {
+                    bool comparable;
+                    int cmp = compare(v, literals[ins.arg], comparable);
+                    if(!comparable) {
+                        return false;
+                    }
+                    switch(ins.opcode) {
+                        case OP_GT: return cmp > 0;
+                        case OP_LT: return cmp < 0;
+                        case OP_GTE: return cmp >= 0;
+                        default: return cmp <= 0;
+                    }
+                }
+            case OP_STARTS_WITH:
+                {
+                    const Value& prefix = literals[ins.arg];
+                    return v && v->IsString() && (prefix.type == TYPE_STRING) &&
+                        (v->GetStringLength() >= prefix.str.size()) &&
+                        (memcmp(v->GetString(), prefix.str.data(), prefix.str.size()) == 0);
+                }
+            case OP_IN:
+                return inSet(v, sets[ins.arg]);
+            case OP_NIN:
+                return !inSet(v, sets[ins.arg]);
+            case OP_EXISTS:
+                return (v != nullptr) == literals[ins.arg].boolean;
+            case OP_TYPE:
+                if(v == nullptr) {
+                    return false;
+                }
+                switch(ins.arg) {
+                    case TYPE_STRING: return v->IsString();
+                    case TYPE_NUMERIC: return v->IsNumber();
+                    case TYPE_BOOLEAN: return v->IsBool();
+                    case TYPE_ARRAY: return v->IsArray();
+                    case TYPE_OBJECT: return v->IsObject();
+                }
+                return false;
+            case OP_REGEX:
+                return v && v->IsString() && 
+                    regexes[ins.arg]->match(v->GetString(), v->GetStringLength());
+            case OP_SIZE:
+                return v && v->IsArray() && (literals[ins.arg].type == TYPE_NUMERIC) &&
+                    (v->Size() == literals[ins.arg].numeric);
+            case OP_ELEM_MATCH:
+                if((v == nullptr) || !v->IsArray()) {
+                    return false;
+                }
+                for(auto& elem : v->GetArray()) {
+                    if(elements[ins.arg]->matches(elem)) {
+                        return true;
+                    }
+                }
+                return false;
+        }
+        return false;
+    }
+
+    bool QueryProgram::executeArray(const Instruction& ins, const ValueType& array) const {
+        // these look at the array itself
+        if((ins.opcode == OP_EXISTS) || (ins.opcode == OP_TYPE) || 
+                (ins.opcode == OP_SIZE) || (ins.opcode == OP_ELEM_MATCH)) {
+            return execute(ins, &array);
+        }
+
+        // the negative operators match if no element has the value
+        Instruction positive = ins;
+        bool negate = false;
+        if(ins.opcode == OP_NE) {
+            positive.opcode = OP_EQ;
+            negate = true;
+        }
+        else if(ins.opcode == OP_NIN) {
+            positive.opcode = OP_IN;
+            negate = true;
+        }
+
+        for(auto& elem : array.GetArray()) {
+            if(execute(positive, &elem)) {
+                return !negate;
+            }
+        }
+        return negate;
+    }
+}
+
@@ -0,0 +1,121 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+#ifndef SPINO_QUERY_PROGRAM_H
+#define SPINO_QUERY_PROGRAM_H
+
+#include "QueryNodes.h"
+
+namespace Spino {
+
+    // a query compiled into a flat list of instructions. each instruction
+    // compares a field against literals and sets a single result register.
+    // $and and $or become conditional jumps, so matching a document 
+    // needs no stack and makes no heap allocations. comparisons on an 
+    // array match if any element matches, and $elemMatch runs a 
+    // program of its own on each element.
+    class QueryProgram {
+        public:
+            QueryProgram() { }
+            QueryProgram(std::shared_ptr<QueryNode> head);
+
+            void compile(std::shared_ptr<QueryNode> head);
+            bool matches(const ValueType& doc) const;
+
+            // sets the value of a ? placeholder. a program with a placeholder
+            // that hasn't been bound doesn't match any document, even where
+            // the placeholder is under $ne, $nin or $not.
+            void bind(uint32_t index, const Value& v);
+            bool allBound() const { return bound; }
+
+            // true if every field the program compares is one of these
+            bool readsOnly(const std::vector<PointerType>& only) const;
+
+        private:
+            enum OPCODE {
+                OP_EQ,
+                OP_NE,
+                OP_GT,
+                OP_LT,
+                OP_GTE,
+                OP_LTE,
+                OP_STARTS_WITH,
+                OP_IN,
+                OP_NIN,
+                OP_EXISTS,
+                OP_TYPE,
+                OP_REGEX,
+                OP_SIZE,
+                OP_ELEM_MATCH,
+                OP_NOT,
+                OP_JUMP_IF_FALSE,
+                OP_JUMP_IF_TRUE
+            };
+
+            // field is an index into fields. arg is an index into literals,
+            // regexes, sets or element programs, a type, or a jump target. 
+            // count is the number of literals for $in and $nin.
+            struct Instruction {
+                uint32_t opcode;
+                uint32_t field;
+                uint32_t arg;
+                uint32_t count;
+            };
+
+            // the literals of an $in or $nin list. strings are found with a
+            // hash table of literal indices and numbers with a binary search,
+            // so they keep the tolerance of an equality comparison.
+            struct LiteralSet {
+                uint32_t first;
+                uint32_t count;
+                std::vector<uint32_t> strings;
+                std::vector<double> numbers;
+                bool has_true = false;
+                bool has_false = false;
+            };
+
+            void compileNode(std::shared_ptr<QueryNode> node);
+            void compileOperator(const PointerType& jp, std::shared_ptr<Operator> op);
+            uint32_t addField(const PointerType& jp);
+            uint32_t addLiteral(std::shared_ptr<QueryNode> node);
+            void addParameter(uint32_t index, uint32_t literal);
+
+            bool checkBound() const;
+            void buildSet(LiteralSet& set);
+            bool inSet(const ValueType* v, const LiteralSet& set) const;
+
+            bool execute(const Instruction& ins, const ValueType* v) const;
+            bool executeArray(const Instruction& ins, const ValueType& array) const;
+            bool equals(const ValueType* v, const Value& literal) const;
+            int compare(const ValueType* v, const Value& literal, bool& comparable) const;
+
+            std::vector<Instruction> code;
+            std::vector<PointerType> fields;
+            std::vector<Value> literals;
+            std::vector<std::shared_ptr<const Regex>> regexes;
+            std::vector<LiteralSet> sets;
+            std::vector<std::shared_ptr<QueryProgram>> elements;
+            // the literal that holds the value of each placeholder
+            std::vector<uint32_t> parameters;
+            bool bound = true;
+    };
+}
+
+#endif
@@ -0,0 +1,618 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+
+#include "Regex.h"
+
+#include <algorithm>
+#include <map>
+#include <cctype>
+
+namespace Spino {
+
+    static const uint32_t INFINITE = UINT32_MAX;
+    static const uint32_t MAX_REPEAT = 1000;
+    static const uint32_t MAX_STATES = 20000;
+    static const uint32_t MAX_DFA_STATES = 1024;
+    // building a DFA from a big NFA takes too long to be worth it
+    static const uint32_t MAX_DFA_NFA_STATES = 2000;
+
+    Regex::Regex(const std::string& p) : pattern(p) {
+        if(pattern.compare(0, 4, "(?i)") == 0) {
+            icase = true;
+            pos = 4;
+        }
+
+        uint32_t root = parseAlternation();
+        if(pos < pattern.size()) {
+            throw regex_error("unmatched )");
+        }
+
+        // state 0 is the match state
+        states.push_back({State::MATCH, 0, 0, 0});
+        start = compile(root, 0);
+
+        bool done = false;
+        findPrefix(root, done);
+
+        buildClasses();
+        buildDfa();
+
+        // the parse tree isn't needed once the program is built
+        nodes.clear();
+        nodes.shrink_to_fit();
+        pattern.clear();
+        pattern.shrink_to_fit();
+    }
+
+    uint32_t Regex::addNode(Node n) {
+        nodes.push_back(std::move(n));
+        return nodes.size() - 1;
+    }
+
+    uint32_t Regex::addSet(CharSet cs) {
+        for(size_t i = 0; i < sets.size(); i++) {
+            if(sets[i] == cs) {
+                return i;
+            }
+        }
+        sets.push_back(cs);
+        return sets.size() - 1;
+    }
+
+    void Regex::addChar(CharSet& cs, unsigned char c) {
+        cs.set(c);
+        if(icase && isalpha(c)) {
+            cs.set(tolower(c));
+            cs.set(toupper(c));
+        }
+    }
+
+    uint32_t Regex::parseAlternation() {
+        Node alt;
+        alt.kind = Node::ALT;
+        alt.children.push_back(parseConcatenation());
+        while((pos < pattern.size()) && (pattern[pos] == '|')) {
+            pos++;
+            alt.children.push_back(parseConcatenation());
+        }
+        if(alt.children.size() == 1) {
+            return alt.children[0];
+        }
+        return addNode(alt);
+    }
+
+    uint32_t Regex::parseConcatenation() {
+        Node cat;
+        cat.kind = Node::CONCAT;
+        while((pos < pattern.size()) && (pattern[pos] != '|') && (pattern[pos] != ')')) {
+            cat.children.push_back(parseRepeat());
+        }
+        if(cat.children.size() == 1) {
+            return cat.children[0];
+        }
+        return addNode(cat);
+    }
+
+    bool Regex::parseCount(uint32_t& n) {
+        size_t begin = pos;
+        n = 0;
+        while((pos < pattern.size()) && isdigit((unsigned char)pattern[pos])) {
+            n = n*10 + (pattern[pos] - '0');
+            if(n > MAX_REPEAT) {
+                throw regex_error("repeat count is too large");
+            }
+            pos++;
+        }
+        return pos != begin;
+    }
+
+    uint32_t Regex::parseRepeat() {
+        uint32_t atom = parseAtom();
+
+        // quantifiers can be stacked, so a** is (a*)*
+        while(pos < pattern.size()) {
+            Node rep;
+            rep.kind = Node::REPEAT;
+            char c = pattern[pos];
+            if(c == '*') {
+                rep.min = 0;
+                rep.max = INFINITE;
+            }
+            else if(c == '+') {
+                rep.min = 1;
+                rep.max = INFINITE;
+            }
+            else if(c == '?') {
+                rep.min = 0;
+                rep.max = 1;
+            }
+            else if(c == '{') {
+                pos++;
+                if(!parseCount(rep.min)) {
+                    throw regex_error("expected a number after {");
+                }
+                rep.max = rep.min;
+                if((pos < pattern.size()) && (pattern[pos] == ',')) {
+                    pos++;
+                    if(!parseCount(rep.max)) {
+                        rep.max = INFINITE;
+                    }
+                }
+                if((pos >= pattern.size()) || (pattern[pos] != '}')) {
+                    throw regex_error("expected }");
+                }
+                if(rep.max < rep.min) {
+                    throw regex_error("bad repeat range");
+                }
+            }
+            else {
+                break;
+            }
+            pos++;
+
+            if((nodes[atom].kind == Node::BOL) || (nodes[atom].kind == Node::EOL)) {
+                throw regex_error("nothing to repeat");
+            }
+
+            // lazy quantifiers match the same strings as greedy ones
+            if((pos < pattern.size()) && (pattern[pos] == '?')) {
+                pos++;
+            }
+
+            rep.children.push_back(atom);
+            atom = addNode(rep);
+        }
+        return atom;
+    }
+
+    uint32_t Regex::parseAtom() {
+        char c = pattern[pos++];
+        Node n;
+        n.kind = Node::SET;
+        CharSet cs;
+        switch(c) {
+            case '(':
+                {
+                    if(pattern.compare(pos, 2, "?:") == 0) {
+                        pos += 2;
+                    }
+                    else if((pos < pattern.size()) && (pattern[pos] == '?')) {
+                        throw regex_error("lookaround and flags inside a pattern aren't supported");
+                    }
+                    uint32_t inner = parseAlternation();
+                    if((pos >= pattern.size()) || (pattern[pos] != ')')) {
+                        throw regex_error("missing )");
+                    }
+                    pos++;
+                    return inner;
+                }
+            case '[':
+                parseClass(cs);
+                break;
+            case '.':
+                cs.set();
+                cs.reset('\n');
+                cs.reset('\r');
+                break;
+            case '^':
+                n.kind = Node::BOL;
+                return addNode(n);
+            case '$':
+                n.kind = Node::EOL;
+                return addNode(n);
+            case '\\':
+                {
+                    int ch;
+                    parseEscape(cs, ch);
+                }
+                break;
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+                throw regex_error("nothing to repeat");
+            default:
+                addChar(cs, c);
+                break;
+        }
+        n.set = addSet(cs);
+        return addNode(n);
+    }
+
+    void Regex::parseEscape(CharSet& cs, int& ch) {
+        if(pos >= pattern.size()) {
+            throw regex_error("trailing \\");
+        }
+        char c = pattern[pos++];
+        ch = -1;
+
+        CharSet cls;
+        bool negate = false;
+        switch(c) {
+            case 'D':
+                negate = true;
+                // fall through
+            case 'd':
+                for(int i = '0'; i <= '9'; i++) {
+                    cls.set(i);
+                }
+                break;
+            case 'W':
+                negate = true;
+                // fall through
+            case 'w':
+                for(int i = 0; i < 256; i++) {
+                    if(isalnum(i) || (i == '_')) {
+                        cls.set(i);
+                    }
+                }
+                break;
+            case 'S':
+                negate = true;
+                // fall through
+            case 's':
+                for(char s : std::string(" \t\n\r\f\v")) {
+                    cls.set(s);
+                }
+                break;
+            case 't': ch = '\t'; break;
+            case 'n': ch = '\n'; break;
+            case 'r': ch = '\r'; break;
+            case 'f': ch = '\f'; break;
+            case 'v': ch = '\v'; break;
+            case '0': ch = 0; break;
+            case 'x':
+                {
+                    if((pos + 2 > pattern.size()) || !isxdigit((unsigned char)pattern[pos]) || 
+                            !isxdigit((unsigned char)pattern[pos+1])) {
+                        throw regex_error("expected two hex digits after \\x");
+                    }
+                    ch = std::stoi(pattern.substr(pos, 2), nullptr, 16);
+                    pos += 2;
+                }
+                break;
+            default:
+                if(isalnum((unsigned char)c)) {
+                    throw regex_error(std::string("unsupported escape \\") + c);
+                }
+                ch = (unsigned char)c;
+                break;
+        }
+
+        if(ch >= 0) {
+            addChar(cs, ch);
+        }
+        else {
+            cs |= negate ? ~cls : cls;
+        }
+    }
+
+    void Regex::parseClass(CharSet& cs) {
+        bool negate = false;
+        if((pos < pattern.size()) && (pattern[pos] == '^')) {
+            negate = true;
+            pos++;
+        }
+
+        while(true) {
+            if(pos >= pattern.size()) {
+                throw regex_error("missing ]");
+            }
+            char c = pattern[pos++];
+            if(c == ']') {
+                break;
+            }
+
+            int lo = (unsigned char)c;
+            if(c == '\\') {
+                parseEscape(cs, lo);
+                if(lo < 0) {
+                    continue;
+                }
+            }
+
+            // a - that isn't between two characters is literal
+            if((pos + 1 < pattern.size()) && (pattern[pos] == '-') && (pattern[pos+1] != ']')) {
+                pos++;
+                int hi = (unsigned char)pattern[pos++];
+                if(hi == '\\') {
+                    CharSet unused;
+                    parseEscape(unused, hi);
+                    if(hi < 0) {
+                        throw regex_error("bad range in []");
+                    }
+                }
+                if(hi < lo) {
+                    throw regex_error("bad range in []");
+                }
+                for(int i = lo; i <= hi; i++) {
+                    addChar(cs, i);
+                }
+            }
+            else {
+                addChar(cs, lo);
+            }
+        }
+
+        if(negate) {
+            cs.flip();
+        }
+    }
+
+    uint32_t Regex::addState(State s) {
+        if(states.size() >= MAX_STATES) {
+            throw regex_error("pattern is too large");
+        }
+        states.push_back(s);
+        return states.size() - 1;
+    }
+
+    uint32_t Regex::compile(uint32_t node, uint32_t next) {
+        const Node& n = nodes[node];
+        switch(n.kind) {
+            case Node::SET:
+                return addState({State::SET, next, 0, n.set});
+            case Node::BOL:
+                return addState({State::BOL, next, 0, 0});
+            case Node::EOL:
+                return addState({State::EOL, next, 0, 0});
+            case Node::CONCAT:
+                for(size_t i = n.children.size(); i > 0; i--) {
+                    next = compile(n.children[i-1], next);
+                }
+                return next;
+            case Node::ALT:
+                {
+                    uint32_t s = compile(n.children.back(), next);
+                    for(size_t i = n.children.size() - 1; i > 0; i--) {
+                        uint32_t branch = compile(n.children[i-1], next);
+                        s = addState({State::SPLIT, branch, s, 0});
+                    }
+                    return s;
+                }
+            case Node::REPEAT:
+                {
+                    uint32_t child = n.children[0];
+                    uint32_t cur = next;
+                    if(n.max == INFINITE) {
+                        uint32_t loop = addState({State::SPLIT, 0, next, 0});
+                        states[loop].out = compile(child, loop);
+                        cur = loop;
+                    }
+                    else {
+                        // each optional copy either continues to the 
+                        // next copy or skips to the end
+                        for(uint32_t i = n.min; i < n.max; i++) {
+                            uint32_t body = compile(child, cur);
+                            cur = addState({State::SPLIT, body, next, 0});
+                        }
+                    }
+                    for(uint32_t i = 0; i < n.min; i++) {
+                        cur = compile(child, cur);
+                    }
+                    return cur;
+                }
+        }
+        return next;
+    }
+
+    void Regex::findPrefix(uint32_t node, bool& done) {
+        const Node& n = nodes[node];
+        switch(n.kind) {
+            case Node::SET:
+                if(sets[n.set].count() == 1) {
+                    for(int i = 0; i < 256; i++) {
+                        if(sets[n.set][i]) {
+                            literal_prefix += (char)i;
+                        }
+                    }
+                }
+                else {
+                    done = true;
+                }
+                break;
+            case Node::CONCAT:
+                for(auto child : n.children) {
+                    findPrefix(child, done);
+                    if(done) {
+                        break;
+                    }
+                }
+                break;
+            case Node::BOL:
+                // a ^ can only match at the start
+                done = literal_prefix.size() > 0;
+                break;
+            case Node::REPEAT:
+                if(n.min > 0) {
+                    findPrefix(n.children[0], done);
+                }
+                done = true;
+                break;
+            default:
+                done = true;
+                break;
+        }
+    }
+
+    void Regex::buildClasses() {
+        // split the bytes into classes until every set contains either 
+        // all or none of the bytes in each class
+        uint32_t cls[256] = {0};
+        n_classes = 1;
+        for(auto& cs : sets) {
+            int remap[512];
+            std::fill(remap, remap + 512, -1);
+            uint32_t n = 0;
+            for(int b = 0; b < 256; b++) {
+                int key = cls[b]*2 + (cs[b] ? 1 : 0);
+                if(remap[key] < 0) {
+                    remap[key] = n++;
+                }
+                cls[b] = remap[key];
+            }
+            n_classes = n;
+        }
+        for(int b = 0; b < 256; b++) {
+            byte_class[b] = cls[b];
+        }
+    }
+
+    // follows the states that don't consume input. SET, MATCH and any EOL 
+    // states that can't be followed yet are left in the list.
+    void Regex::closure(std::vector<uint32_t>& list, bool at_start, bool at_end) const {
+        std::vector<uint32_t> stack(list);
+        std::vector<bool> seen(states.size());
+        list.clear();
+        while(stack.size()) {
+            uint32_t s = stack.back();
+            stack.pop_back();
+            if(seen[s]) {
+                continue;
+            }
+            seen[s] = true;
+
+            const State& st = states[s];
+            switch(st.kind) {
+                case State::SPLIT:
+                    stack.push_back(st.out1);
+                    stack.push_back(st.out);
+                    break;
+                case State::BOL:
+                    if(at_start) {
+                        stack.push_back(st.out);
+                    }
+                    break;
+                case State::EOL:
+                    if(at_end) {
+                        stack.push_back(st.out);
+                    }
+                    else {
+                        list.push_back(s);
+                    }
+                    break;
+                default:
+                    list.push_back(s);
+                    break;
+            }
+        }
+        std::sort(list.begin(), list.end());
+    }
+
+    bool Regex::accepts(const std::vector<uint32_t>& list, bool at_start) const {
+        std::vector<uint32_t> end(list);
+        closure(end, at_start, true);
+        return std::find(end.begin(), end.end(), 0) != end.end();
+    }
+
+    void Regex::buildDfa() {
+        if(states.size() > MAX_DFA_NFA_STATES) {
+            return;
+        }
+
+        char rep[256];
+        for(int b = 255; b >= 0; b--) {
+            rep[byte_class[b]] = b;
+        }
+
+        // the start state isn't put in the map because ^ can only 
+        // match there
+        std::vector<std::vector<uint32_t>> dstates(2);
+        std::map<std::vector<uint32_t>, uint32_t> ids;
+        dstates[1].push_back(start);
+        closure(dstates[1], true, false);
+        ids[dstates[0]] = 0;
+
+        dfa.assign(2 * n_classes, 0);
+        accepting.assign(2, 0);
+        accepting[1] = accepts(dstates[1], true);
+
+        for(uint32_t d = 1; d < dstates.size(); d++) {
+            for(uint32_t c = 0; c < n_classes; c++) {
+                std::vector<uint32_t> next;
+                for(auto s : dstates[d]) {
+                    const State& st = states[s];
+                    if((st.kind == State::SET) && sets[st.set][(unsigned char)rep[c]]) {
+                        next.push_back(st.out);
+                    }
+                }
+                closure(next, false, false);
+
+                auto it = ids.find(next);
+                uint32_t id;
+                if(it != ids.end()) {
+                    id = it->second;
+                }
+                else {
+                    if(dstates.size() >= MAX_DFA_STATES) {
+                        // fall back to simulating the NFA
+                        dfa.clear();
+                        accepting.clear();
+                        return;
+                    }
+                    id = dstates.size();
+                    ids[next] = id;
+                    accepting.push_back(accepts(next, false));
+                    dstates.push_back(std::move(next));
+                    dfa.resize(dstates.size() * n_classes, 0);
+                }
+                dfa[d*n_classes + c] = id;
+            }
+        }
+        use_dfa = true;
+    }
+
+    bool Regex::simulate(const char* s, size_t len) const {
+        std::vector<uint32_t> cur = {start};
+        closure(cur, true, false);
+        std::vector<uint32_t> next;
+        for(size_t i = 0; i < len; i++) {
+            next.clear();
+            for(auto st : cur) {
+                if((states[st].kind == State::SET) && sets[states[st].set][(unsigned char)s[i]]) {
+                    next.push_back(states[st].out);
+                }
+            }
+            if(next.empty()) {
+                return false;
+            }
+            closure(next, false, false);
+            cur.swap(next);
+        }
+        return accepts(cur, len == 0);
+    }
+
+    bool Regex::match(const char* s, size_t len) const {
+        if(!use_dfa) {
+            return simulate(s, len);
+        }
+
+        const uint32_t* table = dfa.data();
+        uint32_t state = 1;
+        for(size_t i = 0; i < len; i++) {
+            state = table[state*n_classes + byte_class[(unsigned char)s[i]]];
+            if(state == 0) {
+                return false;
+            }
+        }
+        return accepting[state];
+    }
+}
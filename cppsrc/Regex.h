@@ -0,0 +1,135 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+#ifndef SPINO_REGEX_H
+#define SPINO_REGEX_H
+
+#include <string>
+#include <vector>
+#include <bitset>
+#include <cstdint>
+#include <exception>
+
+namespace Spino {
+
+    class regex_error: public std::exception {
+        public:
+            regex_error(const std::string& msg) : msg(msg) { }
+
+            virtual const char* what() const throw() {
+                return msg.c_str();
+            }
+
+        private:
+            std::string msg;
+    };
+
+    // a regular expression matcher that runs in linear time. the pattern 
+    // is compiled to a thompson NFA, which is turned into a DFA up front
+    // so matching is a table lookup per byte with no backtracking and no
+    // allocations. patterns that would make a very large DFA are matched 
+    // by simulating the NFA instead, which is still linear.
+    //
+    // supports literals, ., [] classes, \d \w \s and their negations, 
+    // groups, |, * + ? {n} {n,} {n,m}, ^ and $. a pattern that starts 
+    // with (?i) is case insensitive. backreferences and lookaround 
+    // aren't supported. like std::regex_match, the whole string must match.
+    class Regex {
+        public:
+            // throws regex_error if the pattern is invalid
+            explicit Regex(const std::string& pattern);
+
+            bool match(const char* s, size_t len) const;
+            bool match(const std::string& s) const {
+                return match(s.data(), s.size());
+            }
+
+            // literal text that every matching string starts with. 
+            // it can be used to narrow the search with an ordered index.
+            const std::string& prefix() const { return literal_prefix; }
+
+        private:
+            typedef std::bitset<256> CharSet;
+
+            // a node of the parsed pattern
+            struct Node {
+                enum { SET, CONCAT, ALT, REPEAT, BOL, EOL } kind;
+                uint32_t set = 0;
+                uint32_t min = 0;
+                uint32_t max = 0;
+                std::vector<uint32_t> children;
+            };
+
+            // NFA states. SPLIT, BOL and EOL don't consume input
+            struct State {
+                enum { SET, SPLIT, BOL, EOL, MATCH } kind;
+                uint32_t out = 0;
+                uint32_t out1 = 0;
+                uint32_t set = 0;
+            };
+
+            // parser
+            uint32_t parseAlternation();
+            uint32_t parseConcatenation();
+            uint32_t parseRepeat();
+            uint32_t parseAtom();
+            void parseClass(CharSet& cs);
+            // ch is set to the character, or -1 for a class like \d
+            void parseEscape(CharSet& cs, int& ch);
+            bool parseCount(uint32_t& n);
+            uint32_t addNode(Node n);
+            uint32_t addSet(CharSet cs);
+            void addChar(CharSet& cs, unsigned char c);
+
+            // compiles the node so it continues to next and returns 
+            // the first state
+            uint32_t compile(uint32_t node, uint32_t next);
+            uint32_t addState(State s);
+            void findPrefix(uint32_t node, bool& done);
+
+            void buildClasses();
+            void closure(std::vector<uint32_t>& states, bool at_start, bool at_end) const;
+            bool accepts(const std::vector<uint32_t>& states, bool at_start) const;
+            void buildDfa();
+            bool simulate(const char* s, size_t len) const;
+
+            std::string pattern;
+            size_t pos = 0;
+            bool icase = false;
+
+            std::vector<Node> nodes;
+            std::vector<CharSet> sets;
+            std::vector<State> states;
+            uint32_t start = 0;
+            std::string literal_prefix;
+
+            // bytes that every set treats the same way share a class
+            uint8_t byte_class[256];
+            uint32_t n_classes = 0;
+
+            // dfa[state * n_classes + class] is the next state. 
+            // state 0 is dead and state 1 is the start.
+            std::vector<uint32_t> dfa;
+            std::vector<uint8_t> accepting;
+            bool use_dfa = false;
+    };
+}
+
+#endif
@@ -0,0 +1,96 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+
+#include "ResultCache.h"
+#include "HashIndex.h"
+
+namespace Spino {
+
+    size_t ResultCache::Entry::bytes() const {
+        // the key is held by the entry and the map
+        return sizeof(Entry) + key.size() + text.size() + 
+            slots.size() * sizeof(uint32_t) + 32;
+    }
+
+    ResultCache::ResultCache(size_t capacity) : 
+        capacity(capacity), bytes(0), hits(0), misses(0) {
+    }
+
+    const ResultCache::Entry* ResultCache::get(const std::string& key, uint64_t generation) {
+        auto found = map.find(HashIndex::hashString(key.data(), key.size()));
+        if(found != map.end()) {
+            auto entry = found->second;
+            if((entry->key == key) && (entry->generation == generation)) {
+                hits++;
+                lru.splice(lru.begin(), lru, entry);
+                return &*entry;
+            }
+            if(entry->key == key) {
+                // the collection has changed since
+                erase(entry);
+            }
+        }
+        misses++;
+        return nullptr;
+    }
+
+    void ResultCache::put(Entry&& entry) {
+        if(entry.bytes() > capacity) {
+            return;
+        }
+
+        uint32_t hash = HashIndex::hashString(entry.key.data(), entry.key.size());
+        auto found = map.find(hash);
+        if(found != map.end()) {
+            erase(found->second);
+        }
+
+        bytes += entry.bytes();
+        lru.push_front(std::move(entry));
+        map[hash] = lru.begin();
+        evict();
+    }
+
+    void ResultCache::setCapacity(size_t c) {
+        capacity = c;
+        evict();
+    }
+
+    void ResultCache::clear() {
+        lru.clear();
+        map.clear();
+        bytes = 0;
+        hits = 0;
+        misses = 0;
+    }
+
+    void ResultCache::erase(LruList::iterator entry) {
+        bytes -= entry->bytes();
+        map.erase(HashIndex::hashString(entry->key.data(), entry->key.size()));
+        lru.erase(entry);
+    }
+
+    void ResultCache::evict() {
+        while(bytes > capacity) {
+            erase(std::prev(lru.end()));
+        }
+    }
+}
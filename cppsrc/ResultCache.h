@@ -0,0 +1,85 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SPINO_RESULT_CACHE_H
+#define SPINO_RESULT_CACHE_H
+
+#include <list>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+
+namespace Spino {
+
+    // a least recently used cache of query results for one collection.
+    // each result is only valid for the generation of the collection it 
+    // was found in. every write to the collection starts a new generation,
+    // so older results are thrown away when they are next looked up. 
+    // the cache is bounded by the approximate number of bytes it uses.
+    class ResultCache {
+        public:
+            struct Entry {
+                std::string key;
+                uint64_t generation;
+
+                // a serialised document, or the slots of every match
+                std::string text;
+                std::vector<uint32_t> slots;
+
+                size_t bytes() const;
+            };
+
+            ResultCache(size_t capacity = 8 << 20);
+
+            // returns nullptr if there isn't a result for this generation.
+            // the entry is valid until the next call to put().
+            const Entry* get(const std::string& key, uint64_t generation);
+            void put(Entry&& entry);
+
+            // a capacity of zero turns the cache off
+            void setCapacity(size_t capacity);
+            size_t getCapacity() const { return capacity; }
+
+            void clear();
+            size_t size() const { return lru.size(); }
+            size_t getBytes() const { return bytes; }
+            uint64_t getHits() const { return hits; }
+            uint64_t getMisses() const { return misses; }
+
+        private:
+            typedef std::list<Entry> LruList;
+
+            void erase(LruList::iterator entry);
+            void evict();
+
+            // most recently used first. entries are found by the hash of
+            // the key and the whole key is compared.
+            LruList lru;
+            std::unordered_map<uint32_t, LruList::iterator> map;
+            size_t capacity;
+            size_t bytes;
+            uint64_t hits;
+            uint64_t misses;
+    };
+}
+
+#endif
@@ -22,6 +22,7 @@
 #include "SpinoDB.h"
 #include "squirrel.h"
 #include <functional>
+#include <algorithm>
 
 #include <iostream>
 using namespace std;
@@ -29,38 +30,28 @@ using namespace std;
 namespace Spino{
 
     void SpinoDB::clear() {
-        for(auto c : collections) {
-            delete c;
+        for(auto& c : collections) {
+            delete c.second;
         }
         if(keyStore != nullptr) {
             delete keyStore;
             keyStore = nullptr;
         }
+        collections.clear();
+        ordered.clear();
 
-        doc.SetObject();
-
-        const char* keystoreName = "__SpinoKeyValueStore__";
-        ValueType v(rapidjson::kArrayType);
-        ValueType index(keystoreName, doc.GetAllocator());
-        doc.AddMember(index, v, doc.GetAllocator());
-
-        keyStore = new Collection(doc, jw, keystoreName);
-        keyStore->createIndex("k");
+        keyStore = new Collection(jw, query_cache, scan_pool, "__SpinoKeyValueStore__");
+        keyStore->createIndex("k", INDEX_HASH);
     }
 
     Collection* SpinoDB::addCollection(const std::string& name) {
-        for(auto i : collections) {
-            if(i->getName() == name) {
-                return nullptr;
-            }
+        if(collections.find(name) != collections.end()) {
+            return nullptr;
         }
 
-        ValueType v(rapidjson::kArrayType);
-        ValueType index(name.c_str(), doc.GetAllocator());
-        doc.AddMember(index, v, doc.GetAllocator());
-
-        auto c = new Collection(doc, jw, name);
-        collections.push_back(c);
+        auto c = new Collection(jw, query_cache, scan_pool, name);
+        collections[name] = c;
+        ordered.push_back(c);
 
         if(jw.getEnabled()) {
             stringstream ss;
@@ -74,39 +65,36 @@ namespace Spino{
     }
 
     Collection* SpinoDB::getCollection(const std::string& name) {
-        for(auto c : collections) {
-            if(c->getName() == name) {
-                return c;
-            }
+        auto it = collections.find(name);
+        if(it != collections.end()) {
+            return it->second;
         }
 
         return addCollection(name);
     }
 
     bool SpinoDB::hasCollection(const std::string& name) const {
-        for(auto c : collections) {
-            if(c->getName() == name) {
-                return true;
-            }
-        }
-        return false;
+        return collections.find(name) != collections.end();
     }
 
     uint64_t Collection::timestampById(const char* s) {
         return fast_atoi_len(s, 10)*1000;
     }
 
+    size_t SpinoDB::compact() {
+        size_t released = keyStore->compact();
+        for(auto c : ordered) {
+            released += c->compact();
+        }
+        return released;
+    }
+
     void SpinoDB::dropCollection(const std::string& name) {
-        for(auto it = collections.begin(); it != collections.end(); ) {
-            auto c = *it;
-            if(c->getName() == name) {
-                doc.RemoveMember(name.c_str()); //remove from DOM
-                delete c; //delete the collection object
-                collections.erase(it); //remove from the list
-                break;
-            } else {
-                it++;
-            }
+        auto it = collections.find(name);
+        if(it != collections.end()) {
+            ordered.erase(std::find(ordered.begin(), ordered.end(), it->second));
+            delete it->second; // releases the collection's memory pool
+            collections.erase(it);
         }
 
         if(jw.getEnabled()) {
@@ -163,12 +151,15 @@ namespace Spino{
         keyStore->update(query_ss.str().c_str(), kvjson.c_str());
     }
 
-    bool SpinoDB::getBoolValue(const std::string& key) {
-        std::stringstream ss;
-        ss << "{k:\""
-            << escape(key) << "\"}";
+    // finds the document that holds a key. the query is prepared once, 
+    // so the key doesn't need to be escaped and the query isn't parsed
+    std::string SpinoDB::findKey(const std::string& key) {
+        key_query.bindString(0, key.c_str());
+        return keyStore->findOne(key_query);
+    }
 
-        std::string result = keyStore->findOne(ss.str().c_str());
+    bool SpinoDB::getBoolValue(const std::string& key) {
+        std::string result = findKey(key);
         if(result != "") {
             DocType keydoc;
             keydoc.Parse(result.c_str());
@@ -182,11 +173,7 @@ namespace Spino{
     }
 	
     int SpinoDB::getIntValue(const std::string& key) {
-        std::stringstream ss;
-        ss << "{k:\""
-            << escape(key) << "\"}";
-
-        std::string result = keyStore->findOne(ss.str().c_str());
+        std::string result = findKey(key);
         if(result != "") {
             DocType keydoc;
             keydoc.Parse(result.c_str());
@@ -200,12 +187,7 @@ namespace Spino{
     }
 
     unsigned int SpinoDB::getUintValue(const std::string& key) {
-        std::stringstream ss;
-        ss << "{k:\""
-            << escape(key) << "\"}";
-
-
-        std::string result = keyStore->findOne(ss.str().c_str());
+        std::string result = findKey(key);
         if(result != "") {
             DocType keydoc;
             keydoc.Parse(result.c_str());
@@ -219,12 +201,7 @@ namespace Spino{
     }
 
     double SpinoDB::getDoubleValue(const std::string& key) {
-        std::stringstream ss;
-        ss << "{k:\""
-            << escape(key) << "\"}";
-
-
-        std::string result = keyStore->findOne(ss.str().c_str());
+        std::string result = findKey(key);
         if(result != "") {
             DocType keydoc;
             keydoc.Parse(result.c_str());
@@ -238,11 +215,7 @@ namespace Spino{
     }
 
     const char* SpinoDB::getStringValue(const std::string& key) {
-        std::stringstream ss;
-        ss << "{k:\""
-            << escape(key) << "\"}";
-
-        std::string result = keyStore->findOne(ss.str().c_str());
+        std::string result = findKey(key);
 
         if(result != "") {
             DocType keydoc;
@@ -263,11 +236,7 @@ namespace Spino{
     }
 
     bool SpinoDB::hasKey(const std::string& key) {
-        std::stringstream ss;
-        ss << "{k:\""
-            << escape(key) << "\"}";
-
-        std::string result = keyStore->findOne(ss.str().c_str());
+        std::string result = findKey(key);
         return result != "";
     }
 
@@ -349,7 +318,18 @@ namespace Spino{
                     return make_reply(false, "Field is not a string");
                 }
 
-                col->createIndex(fieldValue.GetString());
+                IndexKind kind = INDEX_ORDERED;
+                if(d.HasMember("kind")) {
+                    auto& kindValue = d["kind"];
+                    if(kindValue.IsString() && (strcmp(kindValue.GetString(), "hash") == 0)) {
+                        kind = INDEX_HASH;
+                    }
+                    else if(!kindValue.IsString() || (strcmp(kindValue.GetString(), "ordered") != 0)) {
+                        return make_reply(false, "Unknown index kind");
+                    }
+                }
+
+                col->createIndex(fieldValue.GetString(), kind);
                 return make_reply(true, "Index created");
             }
             else {
@@ -404,7 +384,7 @@ namespace Spino{
             }
         }
 
-        else if(cmdString == "find") {
+        else if((cmdString == "find") || (cmdString == "explain")) {
             auto check = require_fields(d, {"collection", "query"});
             if(check == "") {
                 auto& queryValue = d["query"];
@@ -422,6 +402,20 @@ namespace Spino{
 
 
                 auto cursor = col->find(queryValue.GetString())->setLimit(limit);
+                if(d.HasMember("sort") && d["sort"].IsString()) {
+                    cursor->setSort(d["sort"].GetString());
+                }
+                if(d.HasMember("skip") && d["skip"].IsUint()) {
+                    cursor->setSkip(d["skip"].GetUint());
+                }
+                if(d.HasMember("after") && d["after"].IsString()) {
+                    cursor->resumeAfter(d["after"].GetString());
+                }
+                if(cmdString == "explain") {
+                    std::string plan = cursor->explain();
+                    delete cursor;
+                    return plan;
+                }
                 std::string response = "[";
 
                 std::string docstr = cursor->next();
@@ -583,6 +577,41 @@ namespace Spino{
             }
         }
 
+        else if(cmdString == "distinct") {
+            auto check = require_fields(d, {"collection", "field"});
+            if(check == "") {
+                auto& fieldValue = d["field"];
+                if(!fieldValue.IsString()) {
+                    return make_reply(false, "Field is not a string");
+                }
+                return col->distinct(fieldValue.GetString());
+            }
+            else {
+                return check;
+            }
+        }
+
+        else if(cmdString == "aggregate") {
+            auto check = require_fields(d, {"collection", "pipeline"});
+            if(check == "") {
+                // the pipeline may be an array or a string holding one
+                auto& pipelineValue = d["pipeline"];
+                if(pipelineValue.IsString()) {
+                    return col->aggregate(pipelineValue.GetString());
+                }
+                if(!pipelineValue.IsArray()) {
+                    return make_reply(false, "pipeline must be an array");
+                }
+                rapidjson::StringBuffer sb;
+                rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+                pipelineValue.Accept(writer);
+                return col->aggregate(sb.GetString());
+            }
+            else {
+                return check;
+            }
+        }
+
         else if(cmdString == "dropOlderThan") {
             auto check = require_fields(d, {"collection", "timestamp"});
             if(check == "") {
@@ -600,6 +629,19 @@ namespace Spino{
             }
         }
 
+        else if(cmdString == "compact") {
+            size_t released;
+            if(col != nullptr) {
+                released = col->compact();
+            }
+            else {
+                released = compact();
+            }
+            std::stringstream ss;
+            ss << "{\"r\":1,\"released\":" << released << "}";
+            return ss.str();
+        }
+
         else if(cmdString == "getValue") {
             auto check = require_fields(d, {"key"});
             if(check == "") {
@@ -654,7 +696,14 @@ namespace Spino{
         rapidjson::OStreamWrapper osw(out);
 
         rapidjson::Writer<rapidjson::OStreamWrapper> writer(osw);
-        doc.Accept(writer);
+        writer.StartObject();
+        writer.Key(keyStore->getName().c_str());
+        keyStore->writeDocuments(writer);
+        for(auto c : ordered) {
+            writer.Key(c->getName().c_str());
+            c->writeDocuments(writer);
+        }
+        writer.EndObject();
 
         out.flush();
         out.close();
@@ -675,47 +724,51 @@ namespace Spino{
     bool SpinoDB::load(const std::string& path) {
         const char* keystoreName = "__SpinoKeyValueStore__";
         // clean up
-        for(auto i : collections) {
-            delete i;
+        for(auto& i : collections) {
+            delete i.second;
         }
         delete keyStore;
         keyStore = nullptr;
         collections.clear();
-        doc.SetObject(); // clear the whole dom
+        ordered.clear();
 
+        // the file is parsed into a temporary document. each collection then
+        // copies its documents into its own memory pool and the temporary
+        // document is released
+        DocType loaded;
         try {
             // load json from file
             std::ifstream in(path);
             rapidjson::IStreamWrapper isw(in);
-            doc.ParseStream(isw);
+            loaded.ParseStream(isw);
         }
         catch(...) {
             clear();
             return false;
         }
 
+        if(loaded.HasParseError() || !loaded.IsObject()) {
+            clear();
+            return false;
+        }
+
         // create the collections & key store collection
-        for (auto& m : doc.GetObject()) {
+        for (auto& m : loaded.GetObject()) {
             std::string name = m.name.GetString();
             if(name != keystoreName) {
-                auto c = new Collection(doc, jw, m.name.GetString());
-                collections.push_back(c);
+                auto c = new Collection(jw, query_cache, scan_pool, name, m.value);
+                collections[name] = c;
+                ordered.push_back(c);
             }
         }
 
-        if(doc.HasMember(keystoreName)) {
-            keyStore = new Collection(doc, jw, keystoreName);
-            keyStore->createIndex("k");
+        if(loaded.HasMember(keystoreName)) {
+            keyStore = new Collection(jw, query_cache, scan_pool, keystoreName, loaded[keystoreName]);
         }
         else {
-            ValueType v(rapidjson::kArrayType);
-            ValueType index(keystoreName, doc.GetAllocator());
-            doc.AddMember(index, v, doc.GetAllocator());
-
-            keyStore = new Collection(doc, jw, keystoreName);
-            keyStore->createIndex("k");
-
+            keyStore = new Collection(jw, query_cache, scan_pool, keystoreName);
         }
+        keyStore->createIndex("k", INDEX_HASH);
         return true;
     }
 
@@ -27,6 +27,7 @@
 #include <ctime>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <fstream>
 #include <chrono>
 #include <thread>
@@ -45,21 +46,14 @@ namespace Spino {
 
     class SpinoDB {
         public:
-            SpinoDB() {
-                doc.SetObject();
-
-                const char* keystoreName = "__SpinoKeyValueStore__";
-                ValueType v(rapidjson::kArrayType);
-                ValueType index(keystoreName, doc.GetAllocator());
-                doc.AddMember(index, v, doc.GetAllocator());
-
-                keyStore = new Collection(doc, jw, keystoreName);
-                keyStore->createIndex("k");
+            SpinoDB() : key_query("{k: ?}") {
+                keyStore = new Collection(jw, query_cache, scan_pool, "__SpinoKeyValueStore__");
+                keyStore->createIndex("k", INDEX_HASH);
             }
 
             ~SpinoDB() {
-                for(auto c : collections) {
-                    delete c;
+                for(auto& c : collections) {
+                    delete c.second;
                 }
                 delete keyStore;
             }
@@ -73,6 +67,18 @@ namespace Spino {
             bool hasCollection(const std::string& name) const;
             void dropCollection(const std::string& name);
 
+            // compacts the memory pools of every collection
+            size_t compact();
+
+            // parsed queries are cached and shared by every collection
+            void setQueryCacheSize(size_t n) { query_cache.setCapacity(n); }
+            const QueryCache& getQueryCache() const { return query_cache; }
+
+            // queries that can't use an index scan the collection on this
+            // many threads. the default is 1. 0 uses one thread per core.
+            void setScanThreads(uint32_t n) { scan_pool.setThreads(n); }
+            uint32_t getScanThreads() const { return scan_pool.getThreads(); }
+
             void save(const std::string& db_path) const;
             bool load(const std::string& db_path);
 
@@ -100,6 +106,8 @@ namespace Spino {
             //std::string runScript(const std::string& script);
 
         private:
+            std::string findKey(const std::string& key);
+
             static std::string make_reply(bool success, const std::string& msg) {
                 std::stringstream ss;
                 if(success) {
@@ -121,10 +129,17 @@ namespace Spino {
                 return "";
             }
 
-            std::vector<Collection*> collections;
+            // each collection owns its documents, so they're found by name
+            // without searching a shared DOM
+            std::unordered_map<std::string, Collection*> collections;
+            // the same collections in the order they were added, so that
+            // save() writes them in a stable order
+            std::vector<Collection*> ordered;
             Collection* keyStore = nullptr;
-            DocType doc;
             JournalWriter jw;
+            QueryCache query_cache;
+            ThreadPool scan_pool;
+            PreparedQuery key_query;
     };
 
     std::string escape(const std::string& str);
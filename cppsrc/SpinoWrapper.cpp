@@ -21,7 +21,6 @@
 
 #include "SpinoWrapper.h"
 
-#include <regex>
 
 #include <iostream>
 using namespace std;
@@ -43,6 +42,8 @@ using v8::Value;
 using v8::Array;
 
 v8::Global<Function> CursorWrapper::constructor;
+v8::Global<Function> PreparedQueryWrapper::constructor;
+v8::Global<FunctionTemplate> PreparedQueryWrapper::tpl;
 v8::Global<Function> CollectionWrapper::constructor;
 
 
@@ -59,7 +60,12 @@ void CursorWrapper::Init(Isolate* isolate){
     NODE_SET_PROTOTYPE_METHOD(tpl, "count", count);
     NODE_SET_PROTOTYPE_METHOD(tpl, "setProjection", setProjection);
     NODE_SET_PROTOTYPE_METHOD(tpl, "setLimit", setLimit);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "setSort", setSort);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "setSkip", setSkip);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "resumeToken", resumeToken);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "resumeAfter", resumeAfter);
     NODE_SET_PROTOTYPE_METHOD(tpl, "runScript", runScript);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "explain", explain);
 
     Local<Context> context = isolate->GetCurrentContext();
     constructor.Reset(isolate, tpl->GetFunction(context).ToLocalChecked());
@@ -143,6 +149,19 @@ void CursorWrapper::setProjection(const v8::FunctionCallbackInfo<v8::Value>& arg
     args.GetReturnValue().Set(args.Holder());
 }
 
+void CursorWrapper::setSort(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    CursorWrapper* curwrap = ObjectWrap::Unwrap<CursorWrapper>(args.Holder());
+
+    if(args[0]->IsString()) {
+        v8::String::Utf8Value str(isolate, args[0]);
+
+        curwrap->cursor->setSort(*str);
+    }
+
+    args.GetReturnValue().Set(args.Holder());
+}
+
 void CursorWrapper::setLimit(const v8::FunctionCallbackInfo<v8::Value>& args) {
     Isolate* isolate = args.GetIsolate();
     CursorWrapper* curwrap = ObjectWrap::Unwrap<CursorWrapper>(args.Holder());
@@ -161,6 +180,46 @@ void CursorWrapper::setLimit(const v8::FunctionCallbackInfo<v8::Value>& args) {
     args.GetReturnValue().Set(args.Holder());
 }
 
+void CursorWrapper::setSkip(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    CursorWrapper* curwrap = ObjectWrap::Unwrap<CursorWrapper>(args.Holder());
+
+    if(args[0]->IsNumber()) {
+        uint32_t skip = args[0].As<Number>()->Value();
+        curwrap->cursor->setSkip(skip);
+    }
+    else {
+        isolate->ThrowException(Exception::TypeError(
+                    String::NewFromUtf8(isolate,
+                        "Expected parameter for setSkip to be a number.").ToLocalChecked()));
+
+    }
+
+    args.GetReturnValue().Set(args.Holder());
+}
+
+void CursorWrapper::resumeToken(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    CursorWrapper* curwrap = ObjectWrap::Unwrap<CursorWrapper>(args.Holder());
+    auto token = curwrap->cursor->resumeToken();
+    if(token != "") {
+        args.GetReturnValue().Set(String::NewFromUtf8(isolate, token.c_str()).ToLocalChecked());
+    }
+}
+
+void CursorWrapper::resumeAfter(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    CursorWrapper* curwrap = ObjectWrap::Unwrap<CursorWrapper>(args.Holder());
+
+    if(args[0]->IsString()) {
+        v8::String::Utf8Value str(isolate, args[0]);
+
+        curwrap->cursor->resumeAfter(*str);
+    }
+
+    args.GetReturnValue().Set(args.Holder());
+}
+
 void CursorWrapper::runScript(const v8::FunctionCallbackInfo<v8::Value>& args) {
     Isolate* isolate = args.GetIsolate();
     CursorWrapper* curwrap = ObjectWrap::Unwrap<CursorWrapper>(args.Holder());
@@ -178,6 +237,86 @@ void CursorWrapper::runScript(const v8::FunctionCallbackInfo<v8::Value>& args) {
     }
 }
 
+void CursorWrapper::explain(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    CursorWrapper* curwrap = ObjectWrap::Unwrap<CursorWrapper>(args.Holder());
+    auto plan = curwrap->cursor->explain();
+    args.GetReturnValue().Set(String::NewFromUtf8(isolate, plan.c_str()).ToLocalChecked());
+}
+
+
+void PreparedQueryWrapper::Init(Isolate* isolate){
+    // Prepare constructor template
+    Local<FunctionTemplate> t = FunctionTemplate::New(isolate);
+    t->SetClassName(String::NewFromUtf8(isolate, "PreparedQuery").ToLocalChecked());
+    t->InstanceTemplate()->SetInternalFieldCount(1);
+
+    // Prototype
+    NODE_SET_PROTOTYPE_METHOD(t, "bind", bind);
+
+    Local<Context> context = isolate->GetCurrentContext();
+    constructor.Reset(isolate, t->GetFunction(context).ToLocalChecked());
+    tpl.Reset(isolate, t);
+
+    AddEnvironmentCleanupHook(isolate, [](void*) {
+            constructor.Reset();
+            tpl.Reset();
+            }, nullptr);
+}
+
+void PreparedQueryWrapper::NewInstance(const v8::FunctionCallbackInfo<v8::Value>& args, Spino::PreparedQuery* query) {
+    Isolate* isolate = args.GetIsolate();
+
+    auto cons = Local<Function>::New(isolate, constructor);
+    auto context = isolate->GetCurrentContext();
+    auto instance = cons->NewInstance(context).ToLocalChecked();
+    auto querywrapper = new PreparedQueryWrapper(query);
+    querywrapper->Wrap(instance);
+    args.GetReturnValue().Set(instance);
+}
+
+Spino::PreparedQuery* PreparedQueryWrapper::FromValue(Isolate* isolate, Local<Value> value) {
+    auto t = Local<FunctionTemplate>::New(isolate, tpl);
+    if(!value->IsObject() || !t->HasInstance(value)) {
+        return nullptr;
+    }
+    return ObjectWrap::Unwrap<PreparedQueryWrapper>(value.As<Object>())->query;
+}
+
+void PreparedQueryWrapper::bind(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    PreparedQueryWrapper* querywrap = ObjectWrap::Unwrap<PreparedQueryWrapper>(args.Holder());
+
+    if(!args[0]->IsNumber() || 
+            (args[0].As<Number>()->Value() < 0) ||
+            (args[0].As<Number>()->Value() >= querywrap->query->parameterCount())) {
+        isolate->ThrowException(Exception::RangeError(
+                    String::NewFromUtf8(isolate,
+                        "Parameter index is out of range.").ToLocalChecked()));
+        return;
+    }
+    uint32_t index = args[0].As<Number>()->Value();
+
+    if(args[1]->IsString()) {
+        v8::String::Utf8Value str(isolate, args[1]);
+        querywrap->query->bindString(index, *str);
+    }
+    else if(args[1]->IsNumber()) {
+        querywrap->query->bindNumber(index, args[1].As<Number>()->Value());
+    }
+    else if(args[1]->IsBoolean()) {
+        querywrap->query->bindBool(index, args[1]->IsTrue());
+    }
+    else {
+        isolate->ThrowException(Exception::TypeError(
+                    String::NewFromUtf8(isolate,
+                        "Expected a string, number or boolean to bind.").ToLocalChecked()));
+        return;
+    }
+
+    args.GetReturnValue().Set(args.Holder());
+}
+
 
 void CollectionWrapper::Init(Isolate* isolate){
     // Prepare constructor template
@@ -194,12 +333,18 @@ void CollectionWrapper::Init(Isolate* isolate){
     NODE_SET_PROTOTYPE_METHOD(tpl, "update", update);
     NODE_SET_PROTOTYPE_METHOD(tpl, "findOneById", findOneById);
     NODE_SET_PROTOTYPE_METHOD(tpl, "findOne", findOne);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "aggregate", aggregate);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "distinct", distinct);
     NODE_SET_PROTOTYPE_METHOD(tpl, "find", find);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "prepare", prepare);
     NODE_SET_PROTOTYPE_METHOD(tpl, "dropById", dropById);
     NODE_SET_PROTOTYPE_METHOD(tpl, "dropOne", dropOne);
     NODE_SET_PROTOTYPE_METHOD(tpl, "drop", drop);
     NODE_SET_PROTOTYPE_METHOD(tpl, "dropOlderThan", dropOlderThan);
     NODE_SET_PROTOTYPE_METHOD(tpl, "timestampById", timestampById);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "compact", compact);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "setCompactionBudget", setCompactionBudget);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "compactTombstones", compactTombstones);
 
     Local<Context> context = isolate->GetCurrentContext();
     constructor.Reset(isolate, tpl->GetFunction(context).ToLocalChecked());
@@ -234,7 +379,14 @@ void CollectionWrapper::createIndex(const FunctionCallbackInfo<Value>& args) {
 
     CollectionWrapper* obj = ObjectWrap::Unwrap<CollectionWrapper>(args.Holder());
 
-    obj->collection->createIndex(*str);
+    Spino::IndexKind kind = Spino::INDEX_ORDERED;
+    if(args.Length() >= 2) {
+        v8::String::Utf8Value kindstr(isolate, args[1]);
+        if(strcmp(*kindstr, "hash") == 0) {
+            kind = Spino::INDEX_HASH;
+        }
+    }
+    obj->collection->createIndex(*str, kind);
 }
 
 void CollectionWrapper::dropIndex(const FunctionCallbackInfo<Value>& args) {
@@ -280,18 +432,19 @@ void CollectionWrapper::update(const FunctionCallbackInfo<Value>& args) {
     CollectionWrapper* obj = ObjectWrap::Unwrap<CollectionWrapper>(args.Holder());
 
     try {
-        obj->collection->update(*findstr, *update);
+        auto prepared = PreparedQueryWrapper::FromValue(isolate, args[0]);
+        if(prepared) {
+            obj->collection->update(*prepared, *update);
+        }
+        else {
+            obj->collection->update(*findstr, *update);
+        }
     }
     catch(Spino::parse_error& err){
         isolate->ThrowException(Exception::TypeError(
                     String::NewFromUtf8(isolate,
                         err.what()).ToLocalChecked()));
     }
-    catch(std::regex_error& err) {
-        isolate->ThrowException(Exception::TypeError(
-                    String::NewFromUtf8(isolate,
-                        err.what()).ToLocalChecked()));
-    }
     catch(...) {
         isolate->ThrowException(Exception::TypeError(
                     String::NewFromUtf8(isolate,
@@ -318,18 +471,19 @@ void CollectionWrapper::findOne(const FunctionCallbackInfo<Value>& args) {
     std::string f;
     CollectionWrapper* obj = ObjectWrap::Unwrap<CollectionWrapper>(args.Holder());
     try {
-        f = obj->collection->findOne(*str);
+        auto prepared = PreparedQueryWrapper::FromValue(isolate, args[0]);
+        if(prepared) {
+            f = obj->collection->findOne(*prepared);
+        }
+        else {
+            f = obj->collection->findOne(*str);
+        }
     }
     catch(Spino::parse_error& err){
         isolate->ThrowException(Exception::TypeError(
                     String::NewFromUtf8(isolate,
                         err.what()).ToLocalChecked()));
     }
-    catch(std::regex_error& err) {
-        isolate->ThrowException(Exception::TypeError(
-                    String::NewFromUtf8(isolate,
-                        err.what()).ToLocalChecked()));
-    }
     catch(...) {
         isolate->ThrowException(Exception::TypeError(
                     String::NewFromUtf8(isolate,
@@ -340,6 +494,24 @@ void CollectionWrapper::findOne(const FunctionCallbackInfo<Value>& args) {
     }
 }
 
+void CollectionWrapper::aggregate(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    v8::String::Utf8Value str(isolate, args[0]);
+
+    CollectionWrapper* obj = ObjectWrap::Unwrap<CollectionWrapper>(args.Holder());
+    auto r = obj->collection->aggregate(*str);
+    args.GetReturnValue().Set(String::NewFromUtf8(isolate, r.c_str()).ToLocalChecked());
+}
+
+void CollectionWrapper::distinct(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    v8::String::Utf8Value str(isolate, args[0]);
+
+    CollectionWrapper* obj = ObjectWrap::Unwrap<CollectionWrapper>(args.Holder());
+    auto r = obj->collection->distinct(*str);
+    args.GetReturnValue().Set(String::NewFromUtf8(isolate, r.c_str()).ToLocalChecked());
+}
+
 void CollectionWrapper::find(const FunctionCallbackInfo<Value>& args) {
     Isolate* isolate = args.GetIsolate();
     v8::String::Utf8Value str(isolate, args[0]);
@@ -347,7 +519,8 @@ void CollectionWrapper::find(const FunctionCallbackInfo<Value>& args) {
 
     CollectionWrapper* obj = ObjectWrap::Unwrap<CollectionWrapper>(args.Holder());
     try {
-        auto cursor = obj->collection->find(*str);
+        auto prepared = PreparedQueryWrapper::FromValue(isolate, args[0]);
+        auto cursor = prepared ? obj->collection->find(*prepared) : obj->collection->find(*str);
         if(args.Length() >= 2) {
             uint32_t limit = args[1].As<Number>()->Value();
             cursor = cursor->setLimit(limit);
@@ -359,11 +532,6 @@ void CollectionWrapper::find(const FunctionCallbackInfo<Value>& args) {
                     String::NewFromUtf8(isolate,
                         err.what()).ToLocalChecked()));
     }
-    catch(std::regex_error& err) {
-        isolate->ThrowException(Exception::TypeError(
-                    String::NewFromUtf8(isolate,
-                        err.what()).ToLocalChecked()));
-    }
     catch(...) {
         isolate->ThrowException(Exception::TypeError(
                     String::NewFromUtf8(isolate,
@@ -372,6 +540,20 @@ void CollectionWrapper::find(const FunctionCallbackInfo<Value>& args) {
 
 }
 
+void CollectionWrapper::prepare(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    v8::String::Utf8Value str(isolate, args[0]);
+
+    try {
+        PreparedQueryWrapper::NewInstance(args, new Spino::PreparedQuery(*str));
+    }
+    catch(Spino::parse_error& err){
+        isolate->ThrowException(Exception::TypeError(
+                    String::NewFromUtf8(isolate,
+                        err.what()).ToLocalChecked()));
+    }
+}
+
 void CollectionWrapper::dropById(const FunctionCallbackInfo<Value>& args) {
     Isolate* isolate = args.GetIsolate();
     v8::String::Utf8Value findstr(isolate, args[0]);
@@ -387,7 +569,13 @@ void CollectionWrapper::dropOne(const FunctionCallbackInfo<Value>& args) {
 
     CollectionWrapper* obj = ObjectWrap::Unwrap<CollectionWrapper>(args.Holder());
 
-    obj->collection->dropOne(*findstr);
+    auto prepared = PreparedQueryWrapper::FromValue(isolate, args[0]);
+    if(prepared) {
+        obj->collection->drop(*prepared, 1);
+    }
+    else {
+        obj->collection->dropOne(*findstr);
+    }
 }
 
 void CollectionWrapper::drop(const FunctionCallbackInfo<Value>& args) {
@@ -400,7 +588,8 @@ void CollectionWrapper::drop(const FunctionCallbackInfo<Value>& args) {
 
     CollectionWrapper* obj = ObjectWrap::Unwrap<CollectionWrapper>(args.Holder());
 
-    auto n_dropped = obj->collection->drop(*findstr, limit);
+    auto prepared = PreparedQueryWrapper::FromValue(isolate, args[0]);
+    auto n_dropped = prepared ? obj->collection->drop(*prepared, limit) : obj->collection->drop(*findstr, limit);
     args.GetReturnValue().Set(v8::Number::New(isolate, n_dropped));
 }
 
@@ -422,6 +611,31 @@ void CollectionWrapper::timestampById(const FunctionCallbackInfo<Value>& args) {
     args.GetReturnValue().Set(v8::Date::New(isolate->GetCurrentContext(), ts).ToLocalChecked());
 }
 
+void CollectionWrapper::compact(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    CollectionWrapper* obj = ObjectWrap::Unwrap<CollectionWrapper>(args.Holder());
+
+    auto released = obj->collection->compact();
+    args.GetReturnValue().Set(v8::Number::New(isolate, released));
+}
+
+void CollectionWrapper::setCompactionBudget(const FunctionCallbackInfo<Value>& args) {
+    CollectionWrapper* obj = ObjectWrap::Unwrap<CollectionWrapper>(args.Holder());
+    obj->collection->setCompactionBudget(args[0].As<Number>()->Value());
+}
+
+void CollectionWrapper::compactTombstones(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    CollectionWrapper* obj = ObjectWrap::Unwrap<CollectionWrapper>(args.Holder());
+
+    uint32_t budget = UINT32_MAX;
+    if(args.Length() >= 1) {
+        budget = args[0].As<Number>()->Value();
+    }
+    auto remaining = obj->collection->compactTombstones(budget);
+    args.GetReturnValue().Set(v8::Number::New(isolate, remaining));
+}
+
 
 
 SpinoWrapper::SpinoWrapper() {
@@ -450,6 +664,8 @@ void SpinoWrapper::Init(Local<Object> exports) {
     NODE_SET_PROTOTYPE_METHOD(tpl, "addCollection", addCollection);
     NODE_SET_PROTOTYPE_METHOD(tpl, "getCollection", getCollection);
     NODE_SET_PROTOTYPE_METHOD(tpl, "dropCollection", dropCollection);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "compact", compact);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "setScanThreads", setScanThreads);
 
     NODE_SET_PROTOTYPE_METHOD(tpl, "setBoolValue", setBoolValue);
     NODE_SET_PROTOTYPE_METHOD(tpl, "setIntValue", setIntValue);
@@ -512,10 +728,6 @@ void SpinoWrapper::execute(const FunctionCallbackInfo<Value>& args) {
             response = "Query parse error: ";
             response += err.what();
         }
-        catch(std::regex_error& err) {
-            response = "Bad regex: ";
-            response += err.what();
-        }
         catch(...) {
             response = "Unknown exception caught during query";
         }
@@ -612,6 +824,29 @@ void SpinoWrapper::dropCollection(const FunctionCallbackInfo<Value>& args) {
     obj->spino->dropCollection(*str);
 }
 
+void SpinoWrapper::compact(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    SpinoWrapper* obj = ObjectWrap::Unwrap<SpinoWrapper>(args.Holder());
+
+    auto released = obj->spino->compact();
+    args.GetReturnValue().Set(v8::Number::New(isolate, released));
+}
+
+void SpinoWrapper::setScanThreads(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    SpinoWrapper* obj = ObjectWrap::Unwrap<SpinoWrapper>(args.Holder());
+
+    if(args[0]->IsNumber()) {
+        uint32_t threads = args[0].As<Number>()->Value();
+        obj->spino->setScanThreads(threads);
+    }
+    else {
+        isolate->ThrowException(Exception::TypeError(
+                    String::NewFromUtf8(isolate,
+                        "Expected parameter for setScanThreads to be a number.").ToLocalChecked()));
+    }
+}
+
 void SpinoWrapper::setBoolValue(const FunctionCallbackInfo<Value>& args) {
     Isolate* isolate = args.GetIsolate();
     v8::String::Utf8Value key(isolate, args[0]);
@@ -42,7 +42,12 @@ class CursorWrapper: public node::ObjectWrap {
 		static void count(const v8::FunctionCallbackInfo<v8::Value>& args);
         static void setProjection(const v8::FunctionCallbackInfo<v8::Value>& args);
         static void setLimit(const v8::FunctionCallbackInfo<v8::Value>& args);
+        static void setSort(const v8::FunctionCallbackInfo<v8::Value>& args);
+        static void setSkip(const v8::FunctionCallbackInfo<v8::Value>& args);
+        static void resumeToken(const v8::FunctionCallbackInfo<v8::Value>& args);
+        static void resumeAfter(const v8::FunctionCallbackInfo<v8::Value>& args);
         static void runScript(const v8::FunctionCallbackInfo<v8::Value>& args);
+        static void explain(const v8::FunctionCallbackInfo<v8::Value>& args);
 
 
 		static v8::Global<v8::Function> constructor;
@@ -50,6 +55,27 @@ class CursorWrapper: public node::ObjectWrap {
 };
 
 
+class PreparedQueryWrapper: public node::ObjectWrap {
+	public:
+		PreparedQueryWrapper(Spino::PreparedQuery* query) : query(query) { }
+		~PreparedQueryWrapper() { delete query; }
+
+		static void Init(v8::Isolate* isolate);
+		static void NewInstance(const v8::FunctionCallbackInfo<v8::Value>& args, Spino::PreparedQuery* query);
+
+		// gets the prepared query from a PreparedQuery object. 
+		// returns nullptr for any other value
+		static Spino::PreparedQuery* FromValue(v8::Isolate* isolate, v8::Local<v8::Value> value);
+	private:
+
+		static void bind(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+		static v8::Global<v8::Function> constructor;
+		static v8::Global<v8::FunctionTemplate> tpl;
+		Spino::PreparedQuery* query;
+};
+
+
 class CollectionWrapper: public node::ObjectWrap {
 	public:
 
@@ -69,12 +95,18 @@ class CollectionWrapper: public node::ObjectWrap {
 		static void update(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void findOneById(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void findOne(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void aggregate(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void distinct(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void find(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void prepare(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void dropById(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void dropOne(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void drop(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void dropOlderThan(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void timestampById(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void compact(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void setCompactionBudget(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void compactTombstones(const v8::FunctionCallbackInfo<v8::Value>& args);
 
 
 
@@ -104,6 +136,8 @@ class SpinoWrapper: public node::ObjectWrap {
 		static void addCollection(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void getCollection(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void dropCollection(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void compact(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void setScanThreads(const v8::FunctionCallbackInfo<v8::Value>& args);
 
         static void setBoolValue(const v8::FunctionCallbackInfo<v8::Value>& args);
         static void setIntValue(const v8::FunctionCallbackInfo<v8::Value>& args);
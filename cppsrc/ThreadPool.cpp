@@ -0,0 +1,120 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+
+#include "ThreadPool.h"
+
+namespace Spino {
+
+    ThreadPool::~ThreadPool() {
+        stop();
+    }
+
+    void ThreadPool::stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        start_cv.notify_all();
+        for(auto& t : workers) {
+            t.join();
+        }
+        workers.clear();
+        n_workers = 0;
+        quit = false;
+    }
+
+    void ThreadPool::setThreads(uint32_t n) {
+        std::lock_guard<std::mutex> run_lock(run_mutex);
+        if(n == 0) {
+            n = std::max(1u, std::thread::hardware_concurrency());
+        }
+        if(n == getThreads()) {
+            return;
+        }
+
+        stop();
+        uint64_t current;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            n_workers = n - 1;
+            current = generation;
+        }
+        // new workers wait for the next run, not the last one
+        for(uint32_t i = 1; i < n; i++) {
+            workers.emplace_back(&ThreadPool::work, this, current);
+        }
+    }
+
+    void ThreadPool::runTasks(const std::function<void(uint32_t)>& f, uint32_t n) {
+        uint32_t task;
+        while((task = next_task.fetch_add(1)) < n) {
+            f(task);
+        }
+    }
+
+    void ThreadPool::work(uint64_t seen) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true) {
+            start_cv.wait(lock, [&]() { return quit || (generation != seen); });
+            if(quit) {
+                return;
+            }
+            seen = generation;
+            auto f = job;
+            uint32_t n = n_tasks;
+
+            lock.unlock();
+            runTasks(*f, n);
+            lock.lock();
+            if(++finished == n_workers) {
+                done_cv.notify_one();
+            }
+        }
+    }
+
+    void ThreadPool::run(uint32_t n, const std::function<void(uint32_t)>& f) {
+        std::lock_guard<std::mutex> run_lock(run_mutex);
+        if(workers.empty() || (n < 2)) {
+            for(uint32_t i = 0; i < n; i++) {
+                f(i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &f;
+            n_tasks = n;
+            next_task = 0;
+            finished = 0;
+            generation++;
+        }
+        start_cv.notify_all();
+
+        runTasks(f, n);
+
+        // every worker has to finish with the job before it goes out 
+        // of scope, even if it woke up too late to run any tasks
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait(lock, [&]() { return finished == n_workers; });
+        job = nullptr;
+    }
+}
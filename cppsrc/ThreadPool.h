@@ -0,0 +1,75 @@
+//  Copyright 2022 Sam Cowen <samuel.cowen@camelsoftware.com>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a 
+//  copy of this software and associated documentation files (the "Software"), 
+//  to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+//  and/or sell copies of the Software, and to permit persons to whom the 
+//  Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+//  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+//  DEALINGS IN THE SOFTWARE.
+
+#ifndef SPINO_THREADPOOL_H
+#define SPINO_THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+namespace Spino {
+
+    // a pool of worker threads for scanning collections in parallel.
+    // the pool starts with one thread, which is the caller, so scans
+    // run on a single thread unless more threads are asked for.
+    class ThreadPool {
+        public:
+            ThreadPool() { }
+            ~ThreadPool();
+
+            // 0 uses one thread per core
+            void setThreads(uint32_t n);
+            uint32_t getThreads() const { return workers.size() + 1; }
+
+            // calls f(task) for every task in [0, n_tasks) across the pool
+            // and returns when they have all finished. the calling thread
+            // runs tasks too. tasks must not throw.
+            void run(uint32_t n_tasks, const std::function<void(uint32_t)>& f);
+
+        private:
+            void stop();
+            void work(uint64_t seen);
+            void runTasks(const std::function<void(uint32_t)>& f, uint32_t n);
+
+            std::vector<std::thread> workers;
+            uint32_t n_workers = 0;
+
+            // one run at a time
+            std::mutex run_mutex;
+
+            std::mutex mutex;
+            std::condition_variable start_cv;
+            std::condition_variable done_cv;
+            uint64_t generation = 0;
+            bool quit = false;
+            uint32_t finished = 0;
+
+            const std::function<void(uint32_t)>* job = nullptr;
+            uint32_t n_tasks = 0;
+            std::atomic<uint32_t> next_task{0};
+    };
+}
+
+#endif
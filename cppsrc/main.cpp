@@ -57,6 +57,7 @@ namespace SpinoDB {
 
     void InitAll(Local<Object> exports) {
         CursorWrapper::Init(exports->GetIsolate());
+        PreparedQueryWrapper::Init(exports->GetIsolate());
         CollectionWrapper::Init(exports->GetIsolate());
         SpinoWrapper::Init(exports);
         NODE_SET_METHOD(exports, "escape", escape);
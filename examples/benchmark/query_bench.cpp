@@ -0,0 +1,81 @@
+// measures the cost of matching one document against a query with the 
+// tree walking QueryExecutor and with a compiled QueryProgram.
+//
+// build with meson in this directory:
+//   meson build && ninja -C build && ./build/query_bench
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "QueryParser.h"
+#include "QueryProgram.h"
+
+using namespace Spino;
+
+static const char* queries[] = {
+    "{score: 50}",
+    "{name: \"dave\"}",
+    "{score: {$gt: 90}}",
+    "{name: {$in: [\"dave\", \"sam\", \"bob\"]}}",
+    "{$and: [{name: {$startsWith: \"da\"}}, {score: {$lte: 50}}]}",
+    "{$or: [{score: {$lt: 10}}, {age: {$exists: false}}, {name: {$ne: \"sam\"}}]}",
+    "{name: {$regex: \"(?i)a[lm].*\"}}"
+};
+
+int main() {
+    const int n_docs = 100000;
+    const char* names[] = {"dave", "sam", "bob", "alice", "dan"};
+
+    DocType dom;
+    dom.SetArray();
+    for(int i = 0; i < n_docs; i++) {
+        ValueType doc(rapidjson::kObjectType);
+        ValueType name(names[i%5], dom.GetAllocator());
+        doc.AddMember("name", name, dom.GetAllocator());
+        doc.AddMember("score", i%100, dom.GetAllocator());
+        if(i%3) {
+            doc.AddMember("age", i%80, dom.GetAllocator());
+        }
+        dom.PushBack(doc, dom.GetAllocator());
+    }
+
+    // touch every document once so the first query isn't paying for page faults
+    uint32_t members = 0;
+    for(auto& doc : dom.GetArray()) {
+        members += doc.MemberCount();
+    }
+    std::cout << n_docs << " documents, " << members << " fields" << std::endl;
+
+    for(auto q : queries) {
+        QueryParser parser(q);
+        auto head = parser.parse_expression();
+
+        QueryExecutor exec;
+        uint32_t exec_matches = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(auto& doc : dom.GetArray()) {
+            exec.set_json(&doc);
+            exec_matches += exec.resolve(head);
+        }
+        auto exec_ns = std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - start).count();
+
+        QueryProgram program(head);
+        uint32_t program_matches = 0;
+        start = std::chrono::steady_clock::now();
+        for(auto& doc : dom.GetArray()) {
+            program_matches += program.matches(doc);
+        }
+        auto program_ns = std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - start).count();
+
+        std::cout << q << std::endl;
+        std::cout << "    executor: " << exec_ns / n_docs << " ns/doc, " 
+            << exec_matches << " matches" << std::endl;
+        std::cout << "    program:  " << program_ns / n_docs << " ns/doc, " 
+            << program_matches << " matches" << std::endl;
+    }
+    return 0;
+}
@@ -2,6 +2,7 @@
 #define SPINO_H_INCLUDED
 
 #include "cursor.h"
+#include "prepared_query.h"
 #include "collection.h"
 #include "database.h"
 
@@ -4,6 +4,7 @@
 #include <glib-object.h>
 #include <stdint.h>
 #include "cursor.h"
+#include "prepared_query.h"
 
 G_BEGIN_DECLS
 
@@ -13,12 +14,15 @@ G_DECLARE_FINAL_TYPE(SpinoCollection, spino_collection, Spino, Collection, GObje
 
 gchar* spino_collection_get_name(SpinoCollection* self);
 void spino_collection_create_index(SpinoCollection* self, const gchar* name);
+void spino_collection_create_hash_index(SpinoCollection* self, const gchar* name);
 void spino_collection_drop_index(SpinoCollection* self, const gchar* name);
 void spino_collection_append(SpinoCollection* self, const gchar* doc);
 void spino_collection_update_by_id(SpinoCollection* self, const gchar* id, const gchar* doc);
 void spino_collection_update(SpinoCollection* self, const gchar* query, const gchar* doc);
 gchar* spino_collection_find_one_by_id(SpinoCollection* self, const gchar* id);
 gchar* spino_collection_find_one(SpinoCollection* self, const gchar* query);
+gchar* spino_collection_aggregate(SpinoCollection* self, const gchar* pipeline);
+gchar* spino_collection_distinct(SpinoCollection* self, const gchar* field);
 
 /**
  * spino_collection_find:
@@ -28,6 +32,26 @@ gchar* spino_collection_find_one(SpinoCollection* self, const gchar* query);
  */
 SpinoCursor* spino_collection_find(SpinoCollection* self, const gchar* query);
 
+/**
+ * spino_collection_prepare:
+ * @self: the self
+ * @query: the query string, with ? placeholders for values
+ * Returns: (transfer full) (nullable): the prepared query, or NULL if the query can't be parsed
+ */
+SpinoPreparedQuery* spino_collection_prepare(SpinoCollection* self, const gchar* query);
+
+/**
+ * spino_collection_find_prepared:
+ * @self: the self
+ * @query: the prepared query
+ * Returns: (transfer full):
+ */
+SpinoCursor* spino_collection_find_prepared(SpinoCollection* self, SpinoPreparedQuery* query);
+
+gchar* spino_collection_find_one_prepared(SpinoCollection* self, SpinoPreparedQuery* query);
+void spino_collection_update_prepared(SpinoCollection* self, SpinoPreparedQuery* query, const gchar* doc);
+guint spino_collection_drop_prepared(SpinoCollection* self, SpinoPreparedQuery* query, uint32_t limit);
+
 void spino_collection_drop_by_id(SpinoCollection* self, const gchar* id);
 void spino_collection_drop_one(SpinoCollection* self, const gchar* query);
 guint spino_collection_drop(SpinoCollection* self, const gchar* query, uint32_t limit);
@@ -36,6 +60,28 @@ uint64_t spino_collection_timestamp_by_id(SpinoCollection* self, const gchar* id
 
 uint32_t spino_collection_get_size(SpinoCollection* self);
 
+/**
+ * spino_collection_compact:
+ * @self: the self
+ * Returns: the number of bytes released
+ */
+guint64 spino_collection_compact(SpinoCollection* self);
+
+/**
+ * spino_collection_set_compaction_budget:
+ * @self: the self
+ * @budget: the number of documents the compactor may visit after each write
+ */
+void spino_collection_set_compaction_budget(SpinoCollection* self, guint32 budget);
+
+/**
+ * spino_collection_compact_tombstones:
+ * @self: the self
+ * @budget: the number of documents the compactor may visit
+ * Returns: the number of dropped documents still waiting to be removed
+ */
+guint32 spino_collection_compact_tombstones(SpinoCollection* self, guint32 budget);
+
 
 G_END_DECLS
 
@@ -29,8 +29,46 @@ SpinoCursor* spino_cursor_set_projection(SpinoCursor* self, const gchar* project
  */
 SpinoCursor* spino_cursor_set_limit(SpinoCursor* self, guint limit);
 
+/**
+ * spino_cursor_set_sort:
+ * @self: the self
+ * @sort: the fields to sort by, such as {year: 1, name: -1}
+ * Returns: (transfer none):
+ */
+SpinoCursor* spino_cursor_set_sort(SpinoCursor* self, const gchar* sort);
+
+/**
+ * spino_cursor_set_skip:
+ * @self: the self
+ * @skip: the number of results to skip
+ * Returns: (transfer none):
+ */
+SpinoCursor* spino_cursor_set_skip(SpinoCursor* self, guint skip);
+
+/**
+ * spino_cursor_get_resume_token:
+ * @self: the self
+ * Returns: (transfer full): a token for the position after the last result
+ */
+gchar* spino_cursor_get_resume_token(SpinoCursor* self);
+
+/**
+ * spino_cursor_resume_after:
+ * @self: the self
+ * @token: a token from spino_cursor_get_resume_token
+ * Returns: (transfer none):
+ */
+SpinoCursor* spino_cursor_resume_after(SpinoCursor* self, const gchar* token);
+
 gchar* spino_cursor_run_script(SpinoCursor* self, const gchar* script);
 
+/**
+ * spino_cursor_explain:
+ * @self: the self
+ * Returns: (transfer full): a JSON report of how the query was run
+ */
+gchar* spino_cursor_explain(SpinoCursor* self);
+
 
 G_END_DECLS
 
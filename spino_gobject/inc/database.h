@@ -47,6 +47,20 @@ gboolean spino_database_has_collection(SpinoDatabase* self, const gchar* name);
  */
 void spino_database_drop_collection(SpinoDatabase* self, const gchar* name);
 
+/**
+ * spino_database_compact:
+ * @self: the self
+ * Returns: the number of bytes released
+ */
+guint64 spino_database_compact(SpinoDatabase* self);
+
+/**
+ * spino_database_set_scan_threads:
+ * @self: the self
+ * @threads: the number of threads to scan collections with. 0 uses one per core
+ */
+void spino_database_set_scan_threads(SpinoDatabase* self, guint threads);
+
 /**
  * spino_database_save:
  * @self: the self
@@ -0,0 +1,44 @@
+#ifndef GSPINO_PREPARED_QUERY_H_INCLUDED
+#define GSPINO_PREPARED_QUERY_H_INCLUDED
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define SPINO_TYPE_PREPARED_QUERY (spino_prepared_query_get_type())
+
+G_DECLARE_FINAL_TYPE(SpinoPreparedQuery, spino_prepared_query, Spino, PreparedQuery, GObject)
+
+guint spino_prepared_query_get_parameter_count(SpinoPreparedQuery* self);
+
+/**
+ * spino_prepared_query_bind_string:
+ * @self: the self
+ * @index: the index of the ? placeholder, counting from 0
+ * @value: the value
+ * Returns: (transfer none) (nullable): the self, or NULL if the index is out of range
+ */
+SpinoPreparedQuery* spino_prepared_query_bind_string(SpinoPreparedQuery* self, guint index, const gchar* value);
+
+/**
+ * spino_prepared_query_bind_number:
+ * @self: the self
+ * @index: the index of the ? placeholder, counting from 0
+ * @value: the value
+ * Returns: (transfer none) (nullable): the self, or NULL if the index is out of range
+ */
+SpinoPreparedQuery* spino_prepared_query_bind_number(SpinoPreparedQuery* self, guint index, gdouble value);
+
+/**
+ * spino_prepared_query_bind_bool:
+ * @self: the self
+ * @index: the index of the ? placeholder, counting from 0
+ * @value: the value
+ * Returns: (transfer none) (nullable): the self, or NULL if the index is out of range
+ */
+SpinoPreparedQuery* spino_prepared_query_bind_bool(SpinoPreparedQuery* self, guint index, gboolean value);
+
+G_END_DECLS
+
+#endif
+
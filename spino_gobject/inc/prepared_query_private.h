@@ -0,0 +1,19 @@
+#ifndef SPINO_PREPARED_QUERY_PRIVATE_H
+#define SPINO_PREPARED_QUERY_PRIVATE_H
+
+#include "prepared_query.h"
+#include "cppsrc/SpinoDB.h"
+
+G_BEGIN_DECLS
+
+struct _SpinoPreparedQuery{
+    GObject parent_instance;
+    Spino::PreparedQuery* priv;
+};
+
+SpinoPreparedQuery* spino_prepared_query_new(Spino::PreparedQuery* query);
+
+G_END_DECLS
+
+#endif
+
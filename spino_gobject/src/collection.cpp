@@ -1,5 +1,6 @@
 #include "collection_private.h"
 #include "cursor_private.h"
+#include "prepared_query_private.h"
 
 G_BEGIN_DECLS
 
@@ -46,6 +47,11 @@ void spino_collection_create_index(SpinoCollection* self, const gchar* name)
     self->priv->createIndex(name);
 }
 
+void spino_collection_create_hash_index(SpinoCollection* self, const gchar* name) 
+{
+    self->priv->createIndex(name, Spino::INDEX_HASH);
+}
+
 
 void spino_collection_drop_index(SpinoCollection* self, const gchar* name)
 {
@@ -80,6 +86,16 @@ gchar* spino_collection_find_one(SpinoCollection* self, const gchar* query)
     return g_strdup(self->priv->findOne(query).c_str());
 }
 
+gchar* spino_collection_aggregate(SpinoCollection* self, const gchar* pipeline)
+{
+    return g_strdup(self->priv->aggregate(pipeline).c_str());
+}
+
+gchar* spino_collection_distinct(SpinoCollection* self, const gchar* field)
+{
+    return g_strdup(self->priv->distinct(field).c_str());
+}
+
 SpinoCursor* spino_collection_find(
         SpinoCollection* self, const gchar* query)
 {
@@ -87,6 +103,41 @@ SpinoCursor* spino_collection_find(
     return spino_cursor_new(cursor);
 }
 
+SpinoPreparedQuery* spino_collection_prepare(SpinoCollection* self, const gchar* query)
+{
+    try {
+        return spino_prepared_query_new(new Spino::PreparedQuery(query));
+    }
+    catch(Spino::parse_error& err) {
+        cout << "SpinoDB:: parse error: " << err.what() << endl;
+    }
+    return NULL;
+}
+
+SpinoCursor* spino_collection_find_prepared(
+        SpinoCollection* self, SpinoPreparedQuery* query)
+{
+    auto* cursor = self->priv->find(*query->priv);
+    return spino_cursor_new(cursor);
+}
+
+gchar* spino_collection_find_one_prepared(SpinoCollection* self, SpinoPreparedQuery* query)
+{
+    return g_strdup(self->priv->findOne(*query->priv).c_str());
+}
+
+void spino_collection_update_prepared(
+        SpinoCollection* self, SpinoPreparedQuery* query, const gchar* doc)
+{
+    self->priv->update(*query->priv, doc);
+}
+
+guint spino_collection_drop_prepared(
+        SpinoCollection* self, SpinoPreparedQuery* query, uint32_t limit)
+{
+    return self->priv->drop(*query->priv, limit);
+}
+
 
 void spino_collection_drop_by_id(SpinoCollection* self, const gchar* id)
 {
@@ -119,5 +170,20 @@ uint32_t spino_collection_get_size(SpinoCollection* self)
     return self->priv->size();
 }
 
+guint64 spino_collection_compact(SpinoCollection* self)
+{
+    return self->priv->compact();
+}
+
+void spino_collection_set_compaction_budget(SpinoCollection* self, guint32 budget)
+{
+    self->priv->setCompactionBudget(budget);
+}
+
+guint32 spino_collection_compact_tombstones(SpinoCollection* self, guint32 budget)
+{
+    return self->priv->compactTombstones(budget);
+}
+
 
 G_END_DECLS
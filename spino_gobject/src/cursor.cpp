@@ -62,10 +62,38 @@ SpinoCursor* spino_cursor_set_limit(SpinoCursor* self, guint limit)
     return self;
 }
 
+SpinoCursor* spino_cursor_set_sort(SpinoCursor* self, const gchar* sort)
+{
+    self->priv->setSort(sort);
+    return self;
+}
+
+SpinoCursor* spino_cursor_set_skip(SpinoCursor* self, guint skip)
+{
+    self->priv->setSkip(skip);
+    return self;
+}
+
+gchar* spino_cursor_get_resume_token(SpinoCursor* self)
+{
+    return g_strdup(self->priv->resumeToken().c_str());
+}
+
+SpinoCursor* spino_cursor_resume_after(SpinoCursor* self, const gchar* token)
+{
+    self->priv->resumeAfter(token);
+    return self;
+}
+
 
 gchar* spino_cursor_run_script(SpinoCursor* self, const gchar* script)
 {
     return g_strdup(self->priv->runScript(script).c_str());
 }
 
+gchar* spino_cursor_explain(SpinoCursor* self)
+{
+    return g_strdup(self->priv->explain().c_str());
+}
+
 G_END_DECLS
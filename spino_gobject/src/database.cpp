@@ -74,6 +74,16 @@ void spino_database_drop_collection(SpinoDatabase* self, const gchar* name)
     self->db->dropCollection(name);
 }
 
+guint64 spino_database_compact(SpinoDatabase* self)
+{
+    return self->db->compact();
+}
+
+void spino_database_set_scan_threads(SpinoDatabase* self, guint threads)
+{
+    self->db->setScanThreads(threads);
+}
+
 
 void spino_database_save(SpinoDatabase* self, const gchar* path)
 {
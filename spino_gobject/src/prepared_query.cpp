@@ -0,0 +1,62 @@
+#include "prepared_query_private.h"
+
+G_BEGIN_DECLS
+
+
+G_DEFINE_TYPE(SpinoPreparedQuery, spino_prepared_query, G_TYPE_OBJECT)
+
+
+static void spino_prepared_query_finalize(GObject* object)
+{
+    SpinoPreparedQuery* self = (SpinoPreparedQuery*)object;
+    delete self->priv;
+    G_OBJECT_CLASS(spino_prepared_query_parent_class)->finalize(object);
+}
+
+static void spino_prepared_query_class_init(SpinoPreparedQueryClass* klass) 
+{
+    G_OBJECT_CLASS(klass)->finalize = spino_prepared_query_finalize;
+}
+
+static void spino_prepared_query_init(SpinoPreparedQuery* self) 
+{
+
+}
+
+SpinoPreparedQuery* spino_prepared_query_new(Spino::PreparedQuery* query)
+{
+    SpinoPreparedQuery* q = (SpinoPreparedQuery*)g_object_new(SPINO_TYPE_PREPARED_QUERY, NULL);
+    q->priv = query;
+    return q;
+}
+
+guint spino_prepared_query_get_parameter_count(SpinoPreparedQuery* self)
+{
+    return self->priv->parameterCount();
+}
+
+SpinoPreparedQuery* spino_prepared_query_bind_string(SpinoPreparedQuery* self, guint index, const gchar* value)
+{
+    if(!self->priv->bindString(index, value)) {
+        return NULL;
+    }
+    return self;
+}
+
+SpinoPreparedQuery* spino_prepared_query_bind_number(SpinoPreparedQuery* self, guint index, gdouble value)
+{
+    if(!self->priv->bindNumber(index, value)) {
+        return NULL;
+    }
+    return self;
+}
+
+SpinoPreparedQuery* spino_prepared_query_bind_bool(SpinoPreparedQuery* self, guint index, gboolean value)
+{
+    if(!self->priv->bindBool(index, value)) {
+        return NULL;
+    }
+    return self;
+}
+
+G_END_DECLS